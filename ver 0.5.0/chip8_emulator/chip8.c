@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #include <time.h>
 
 #include "SDL.h"
@@ -28,241 +29,748 @@ typedef struct {
     uint8_t NN;                           // 8 bit constant
     uint8_t N;                            // 4 bit const
     uint8_t X;                            // 4 bit register id                   
-    uint8_t Y;                            // 4 bit register id           
+    uint8_t Y;                            // 4 bit register id
 } instruction_t;
 
+// every instruction, once: X(handler, mask, match, mnemonic, operands, description)
+// an opcode is the first entry where (opcode & mask) == match. Masks may only test the
+// top nibble and low byte (see opcode_id). handler names the OP_ case both interpreters
+// dispatch to; operands and description are templates for format_opcode
+#define CHIP8_OPCODES(X) \
+    X(CLS,    0xF0FF, 0x00E0, "CLS",  "",                "Clear the screen.") \
+    X(RET,    0xF0FF, 0x00EE, "RET",  "",                "Return from subroutine.") \
+    X(SCD,    0xF0F0, 0x00C0, "SCD",  "{N}",             "Scroll the display down N ({N}) pixels (SCHIP).") \
+    X(SCU,    0xF0F0, 0x00D0, "SCU",  "{N}",             "Scroll the display up N ({N}) pixels (XO-CHIP).") \
+    X(SCR,    0xF0FF, 0x00FB, "SCR",  "",                "Scroll the display right 4 pixels (SCHIP).") \
+    X(SCL,    0xF0FF, 0x00FC, "SCL",  "",                "Scroll the display left 4 pixels (SCHIP).") \
+    X(EXIT,   0xF0FF, 0x00FD, "EXIT", "",                "Exit the interpreter (SCHIP).") \
+    X(LOW,    0xF0FF, 0x00FE, "LOW",  "",                "Switch to 64x32 low resolution and clear the screen (SCHIP).") \
+    X(HIGH,   0xF0FF, 0x00FF, "HIGH", "",                "Switch to 128x64 high resolution and clear the screen (SCHIP).") \
+    X(JP,     0xF000, 0x1000, "JP",   "{NNN}",           "Jump to address NNN ({NNN})") \
+    X(CALL,   0xF000, 0x2000, "CALL", "{NNN}",           "Call subroutine at NNN ({NNN})") \
+    X(SE,     0xF000, 0x3000, "SE",   "V{X}, {NN}",      "Check if V{X} == NN ({NN}), skip next instruction if true.") \
+    X(SNE,    0xF000, 0x4000, "SNE",  "V{X}, {NN}",      "Check if V{X} != NN ({NN}), skip next instruction if true.") \
+    X(SE_V,   0xF00F, 0x5000, "SE",   "V{X}, V{Y}",      "Check if V{X} == V{Y}, skip next instruction if true.") \
+    X(ST_XY,  0xF00F, 0x5002, "LD",   "[I], V{X}-V{Y}",  "Store V{X} to V{Y} inclusive at memory from I, leaving I (XO-CHIP)") \
+    X(LD_XY,  0xF00F, 0x5003, "LD",   "V{X}-V{Y}, [I]",  "Load V{X} to V{Y} inclusive from memory at I, leaving I (XO-CHIP)") \
+    X(LD,     0xF000, 0x6000, "LD",   "V{X}, {NN}",      "Set register V{X} to NN ({NN})") \
+    X(ADD,    0xF000, 0x7000, "ADD",  "V{X}, {NN}",      "Set register V{X} += NN ({NN})") \
+    X(LD_V,   0xF00F, 0x8000, "LD",   "V{X}, V{Y}",      "Set register V{X} = V{Y}") \
+    X(OR,     0xF00F, 0x8001, "OR",   "V{X}, V{Y}",      "Set register V{X} |= V{Y}") \
+    X(AND,    0xF00F, 0x8002, "AND",  "V{X}, V{Y}",      "Set register V{X} &= V{Y}") \
+    X(XOR,    0xF00F, 0x8003, "XOR",  "V{X}, V{Y}",      "Set register V{X} ^= V{Y}") \
+    X(ADD_V,  0xF00F, 0x8004, "ADD",  "V{X}, V{Y}",      "Set register V{X} += V{Y}, VF = 1 if carry") \
+    X(SUB,    0xF00F, 0x8005, "SUB",  "V{X}, V{Y}",      "Set register V{X} -= V{Y}, VF = 1 if no borrow") \
+    X(SHR,    0xF00F, 0x8006, "SHR",  "V{X}",            "Set register V{X} >>= 1, VF = shifted off bit") \
+    X(SUBN,   0xF00F, 0x8007, "SUBN", "V{X}, V{Y}",      "Set register V{X} = V{Y} - V{X}, VF = 1 if no borrow") \
+    X(SHL,    0xF00F, 0x800E, "SHL",  "V{X}",            "Set register V{X} <<= 1, VF = shifted off bit") \
+    X(SNE_V,  0xF000, 0x9000, "SNE",  "V{X}, V{Y}",      "Check if V{X} != V{Y}, skip next instruction if true.") \
+    X(LD_I,   0xF000, 0xA000, "LD",   "I, {NNN}",        "Set I to NNN ({NNN}).") \
+    X(JP_V0,  0xF000, 0xB000, "JP",   "V0, {NNN}",       "Set PC to V0 + NNN ({NNN}).") \
+    X(RND,    0xF000, 0xC000, "RND",  "V{X}, {NN}",      "Set V{X} = (rand() % 256) & NN ({NN})") \
+    X(DRW16,  0xF00F, 0xD000, "DRW",  "V{X}, V{Y}, 0",   "Draw 16x16 sprite at coords V{X}, V{Y} from memory location I (SCHIP). Set VF = 1 if any pixels are turned off.") \
+    X(DRW,    0xF000, 0xD000, "DRW",  "V{X}, V{Y}, {N}", "Draw N ({N}) height sprite at coords V{X}, V{Y} from memory location I. Set VF = 1 if any pixels are turned off.") \
+    X(SKP,    0xF0FF, 0xE09E, "SKP",  "V{X}",            "Skip next instruction if key in V{X} is pressed.") \
+    X(SKNP,   0xF0FF, 0xE0A1, "SKNP", "V{X}",            "Skip next instruction if key in V{X} is not pressed.") \
+    X(LONG,   0xF0FF, 0xF000, "LD",   "I, long",         "Set I to the 16 bit address in the next two bytes (XO-CHIP)") \
+    X(PLANE,  0xF0FF, 0xF001, "PLN",  "{X}",             "Select display planes {X} (bit per plane) for drawing, clearing and scrolling (XO-CHIP)") \
+    X(LD_DT,  0xF0FF, 0xF007, "LD",   "V{X}, DT",        "Set V{X} = delay timer value") \
+    X(LD_K,   0xF0FF, 0xF00A, "LD",   "V{X}, K",         "Await until a key is pressed. Store key in V{X}") \
+    X(SET_DT, 0xF0FF, 0xF015, "LD",   "DT, V{X}",        "Set delay timer value = V{X}") \
+    X(SET_ST, 0xF0FF, 0xF018, "LD",   "ST, V{X}",        "Set sound timer value = V{X}") \
+    X(ADD_I,  0xF0FF, 0xF01E, "ADD",  "I, V{X}",         "I += V{X}") \
+    X(LD_F,   0xF0FF, 0xF029, "LD",   "F, V{X}",         "Set I to sprite location in memory for character in V{X}") \
+    X(LD_HF,  0xF0FF, 0xF030, "LD",   "HF, V{X}",        "Set I to 10 byte sprite location in memory for character in V{X} (SCHIP)") \
+    X(LD_B,   0xF0FF, 0xF033, "LD",   "B, V{X}",         "Store BCD representation of V{X} at memory from I") \
+    X(STORE,  0xF0FF, 0xF055, "LD",   "[I], V{X}",       "Register dump V0-V{X} inclusive at memory from I") \
+    X(LOAD,   0xF0FF, 0xF065, "LD",   "V{X}, [I]",       "Register load V0-V{X} inclusive at memory from I") \
+    X(SAVE_R, 0xF0FF, 0xF075, "LD",   "R, V{X}",         "Store V0-V{X} inclusive in the RPL user flags (SCHIP)") \
+    X(LOAD_R, 0xF0FF, 0xF085, "LD",   "V{X}, R",         "Load V0-V{X} inclusive from the RPL user flags (SCHIP)")
+
+typedef enum {
+#define OPCODE_ENUM(handler, ...) OP_##handler,
+    CHIP8_OPCODES(OPCODE_ENUM)
+#undef OPCODE_ENUM
+    OP_INVALID,                           // anything the table doesn't match; executes as a no-op
+    NUM_OPCODES
+} opcode_id_t;
+
+typedef struct {
+    uint16_t mask;
+    uint16_t match;
+    const char *mnemonic;
+    const char *operands;                 // template: {X} {Y} {N} {NN} {NNN}
+    const char *description;              // same template syntax
+} opcode_info_t;
+
+// behaviours that differ between CHIP-8 interpreters
+typedef struct {
+    bool vf_reset;                        // 8XY1/8XY2/8XY3 clear VF
+    bool shift_vy;                        // 8XY6/8XYE shift VY into VX, rather than VX in place
+    bool load_store_inc;                  // FX55/FX65 leave I at I + X + 1
+    bool wrap_sprites;                    // DXYN wraps at the screen edges rather than clipping
+    bool jump_vx;                         // BXNN jumps to XNN + VX, rather than NNN + V0
+    bool vf_clear_on_no_carry;            // 8XY4 clears VF without a carry, rather than leaving it
+    bool flag_after_result;               // 8XY4-8XYE write VF after VX (X == F keeps the flag), not before
+    bool schip;                           // SCHIP instructions: hi-res, scrolling, DXY0, FX30, FX75/FX85
+    bool xochip;                          // XO-CHIP: 64K ram, F000 NNNN, 5XY2/5XY3, FN01 planes, 00DN
+} chip8_quirks_t;
+
+// X(id, name, extension, vf_reset, shift_vy, load_store_inc, wrap_sprites, jump_vx,
+//   vf_clear_on_no_carry, flag_after_result, schip, xochip)
+// a ROM runs as the platform its file extension names, CHIP8 if none does, or --platform.
+// CHIP8 keeps this emulator's original semantics; COSMAC is the original interpreter's
+#define CHIP8_PLATFORMS(X) \
+    X(CHIP8,  "chip8",  ".ch8", false, false, false, false, false, false, false, false, false) \
+    X(COSMAC, "cosmac", ".c8",  true,  true,  true,  false, false, true,  true,  false, false) \
+    X(SCHIP,  "schip",  ".sc8", false, false, false, false, true,  false, false, true,  false) \
+    X(XOCHIP, "xochip", ".xo8", false, true,  true,  true,  false, true,  true,  true,  true)
+
+typedef enum {
+#define PLATFORM_ENUM(id, ...) PLATFORM_##id,
+    CHIP8_PLATFORMS(PLATFORM_ENUM)
+#undef PLATFORM_ENUM
+    NUM_PLATFORMS
+} chip8_platform_t;
+
+// chip8 memory is paged so instances of one ROM can share everything they never write.
+// The address space is XO-CHIP's 64K; other platforms wrap at 4K (see chip8_mem_t.mask)
+#define RAM_SIZE 65536
+#define RAM_PAGE_SIZE 256
+#define RAM_PAGES (RAM_SIZE / RAM_PAGE_SIZE)
+#define CHIP8_RAM_SIZE 4096               // address space of every platform but XO-CHIP
+
+// read-only memory image (font + ROM), loaded once and shared by every instance
+typedef struct {
+    uint8_t ram[RAM_SIZE];
+} chip8_image_t;
+
+// bit per ram page
+typedef struct {
+    uint64_t bits[RAM_PAGES / 64];
+} page_set_t;
+
+// the display is SCHIP sized: 128x64 in hi-res, and the top left 64x32 in lo-res. Each row is
+// one 128 bit row per bit-plane, leftmost pixel in the top bit, so sprites XOR in and scrolls
+// move a row at once. A pixel's colour is its bits across the planes (XO-CHIP; others use plane 0)
+#define DISPLAY_WIDTH 128
+#define DISPLAY_HEIGHT 64
+#define DISPLAY_PLANES 4
+#define DISPLAY_BANDS 8                   // 8-row bands of the display, tracked for incremental hashing
+#define DISPLAY_BAND_ROWS (DISPLAY_HEIGHT / DISPLAY_BANDS)
+#define RPL_FLAGS 16                      // SCHIP FX75/FX85 user flags
+#define BIG_FONT_ADDR 0x50                // SCHIP 8x10 font, 10 bytes per digit
+
+// a row is two words, the left 64 pixels in hi: not every compiler has a 128 bit integer (MSVC
+// doesn't), so rows are worked on through the row_ helpers below
+typedef struct {
+    uint64_t hi;
+    uint64_t lo;
+} display_row_t;
+
+// a plane keeps the left words of its rows apart from the right ones. SCHIP and XO-CHIP displays
+// (quirks.schip) are full planes; CHIP-8 and COSMAC never leave lo-res, so their one plane is
+// allocated only up to the left words of the top 32 rows, and is read and written through
+// row_get/row_put, which leave the rest alone
+typedef struct {
+    uint64_t hi[DISPLAY_HEIGHT];          // left 64 pixels of each row
+    uint64_t lo[DISPLAY_HEIGHT];          // right 64 pixels of each row
+} display_plane_t;
+
+static inline display_row_t row_or(display_row_t a, display_row_t b)
+{
+    return (display_row_t){ a.hi | b.hi, a.lo | b.lo };
+}
+
+static inline display_row_t row_and(display_row_t a, display_row_t b)
+{
+    return (display_row_t){ a.hi & b.hi, a.lo & b.lo };
+}
+
+static inline display_row_t row_xor(display_row_t a, display_row_t b)
+{
+    return (display_row_t){ a.hi ^ b.hi, a.lo ^ b.lo };
+}
+
+static inline bool row_any(display_row_t a)
+{
+    return (a.hi | a.lo) != 0;
+}
+
+// move pixels n columns right; those pushed past the right edge are lost
+static inline display_row_t row_shr(display_row_t a, uint32_t n)
+{
+    if (n == 0) return a;
+    if (n >= DISPLAY_WIDTH) return (display_row_t){ 0, 0 };
+    if (n >= 64) return (display_row_t){ 0, a.hi >> (n - 64) };
+    return (display_row_t){ a.hi >> n, a.lo >> n | a.hi << (64 - n) };
+}
+
+// move pixels n columns left; those pushed past the left edge are lost
+static inline display_row_t row_shl(display_row_t a, uint32_t n)
+{
+    if (n == 0) return a;
+    if (n >= DISPLAY_WIDTH) return (display_row_t){ 0, 0 };
+    if (n >= 64) return (display_row_t){ a.lo << (n - 64), 0 };
+    return (display_row_t){ a.hi << n | a.lo >> (64 - n), a.lo << n };
+}
+
+// the 8 pixels from column x, a multiple of 8, leftmost in the top bit
+static inline uint8_t row_byte(display_row_t a, uint32_t x)
+{
+    return (uint8_t)(x < 64 ? a.hi >> (56 - x) : a.lo >> (120 - x));
+}
+
+// row y of plane p; the right half of a display that isn't full reads as blank
+static inline display_row_t row_get(const display_plane_t *display, uint8_t p, uint8_t y, bool full)
+{
+    return (display_row_t){ display[p].hi[y], full ? display[p].lo[y] : 0 };
+}
+
+// set row y of plane p; a display that isn't full only takes the left half
+static inline void row_put(display_plane_t *display, uint8_t p, uint8_t y, display_row_t row, bool full)
+{
+    display[p].hi[y] = row.hi;
+    if (full) display[p].lo[y] = row.lo;
+}
+
+// bytes allocated for a display of planes planes: all of them when full, else the left words of
+// the top 32 rows of one
+static inline size_t display_bytes(uint8_t planes, bool full)
+{
+    return full ? planes * sizeof(display_plane_t) : DISPLAY_HEIGHT / 2 * sizeof(uint64_t);
+}
+
+// DXYN sprites as last drawn: rows already shifted to their column and masked, so redrawing the
+// same sprite in the same column is loads and XORs. An entry remembers the write generation of
+// the pages its data came from, and is stale once it has moved on
+#define SPRITE_CACHE_BITS 5
+#define SPRITE_CACHE_SIZE (1 << SPRITE_CACHE_BITS)   // entries, direct mapped
+#define SPRITE_MAX_ROWS 16
+
+typedef struct {
+    uint16_t addr;                        // sprite data address
+    uint8_t X;                            // display column
+    uint8_t shape;                        // rows | wide << 5 | hires << 6 | wrap << 7
+    uint64_t generation;                  // mem_range_generation of its data when cached
+    display_row_t rows[SPRITE_MAX_ROWS];
+} sprite_entry_t;
+
+typedef struct {
+    sprite_entry_t entry[SPRITE_CACHE_SIZE];
+} sprite_cache_t;
+
+// copy-on-write memory: pages point into the shared image until first written. The page table
+// lives outside the machine, so a machine stays small enough to copy and to keep many of
+typedef struct {
+    uint8_t **page;                       // current contents of each 256 byte page
+    uint32_t *generation;                 // per page, bumped by every change to its contents; never goes back
+    const chip8_image_t *image;           // backing image for pages not yet written
+    uint16_t mask;                        // address bits in use: RAM_SIZE - 1, or 4K - 1 for CHIP-8 and SCHIP
+    page_set_t owned;                     // set once the page is a private copy
+    page_set_t dirty;                     // set by writes since the last checkpoint
+    page_set_t written;                   // set by changes since the last incremental hash
+    sprite_cache_t *sprites;              // allocated by the first draw, freed with the private pages
+} chip8_mem_t;
+
+// the subroutine stack is a ring, so a runaway ROM wraps around instead of
+// writing past it; the wrap is latched in fault rather than checked
+#define STACK_DEPTH 16
+
+// chip8_t.fault bits: latched by the interpreter and never cleared by it
+typedef enum {
+    FAULT_STACK_OVERFLOW  = 1 << 0,       // 2NNN with the stack full
+    FAULT_STACK_UNDERFLOW = 1 << 1,       // 00EE with the stack empty
+    FAULT_BAD_KEY         = 1 << 2,       // EX9E/EXA1 with VX > 0xF
+} chip8_fault_t;
+
 // chip8 machine obj
 typedef struct {
     emulator_state_t state;
-    uint8_t ram[4096];
-    uint8_t display[64*32];               // if using pointers: display == &ram[0xF00]; e.g the upper most 256 bits of ram
-    uint16_t stack[12];                   // Subroutine stack
-    uint16_t *stack_ptr;                  // Stack pointer
+    chip8_mem_t mem;                      // paged ram, see mem_read/mem_write
+    chip8_image_t *own_image;             // image loaded by init_chip8, freed with the machine
+    display_plane_t *display;             // display[plane].hi/lo[row], packed rows (see DISPLAY_WIDTH); allocated with the machine
+    uint8_t display_planes;               // planes at display
+    bool display_full;                    // display has hi-res rows and right halves (see display_plane_t)
+    uint8_t display_written;              // bit per display band, set by changes since the last incremental hash
+    bool hires;                           // SCHIP 128x64 mode (00FF); 00FE goes back to 64x32
+    uint8_t planes;                       // bit per display plane that draws, clears and scrolls act on (FN01)
+    uint8_t rpl[RPL_FLAGS];               // SCHIP user flags, saved and loaded by FX75/FX85
+    uint16_t stack[STACK_DEPTH];          // Subroutine stack
+    uint8_t stack_ptr;                    // Stack index, wraps at STACK_DEPTH
+    uint8_t fault;                        // chip8_fault_t bits latched so far
+    chip8_platform_t platform;            // which quirks the interpreter runs with
     uint8_t V[16];                        // Data registers V0 to VF
     uint16_t I;                           // Index register
     uint16_t PC;                          // Program counter
     uint8_t delay_timer;                  // Decrements at 60hz when >0
     uint8_t sound_timer;                  // Decrements at 60hz and plays tone when >0
     bool keypad[16];                      // Hexadeicaml Keypad 0x0 to 0xF
+    uint32_t rng;                         // CXNN random state, part of the machine so runs replay
+    uint32_t checkpoint_serial;           // serial of the checkpoint mem.dirty is relative to
+    uint64_t cycles;                      // Instructions executed
     char *rom_name;                       // Currently running ROM
     instruction_t inst;                   // Currently executing Instruction
 } chip8_t;
 
-// - - - - - - - -
-// IFDEF
-// - - - - - - - -
+// saved machine state; restoring into the machine that took it copies back only dirty pages
+typedef struct {
+    chip8_t machine;                      // registers etc. (mem page table and display unused)
+    uint8_t *ram;                         // contents of pages that were private at checkpoint, by address
+    uint32_t ram_size;                    // bytes allocated at ram: up to the highest private page
+    display_plane_t *display;             // the machine's display planes
+    uint8_t display_planes;               // planes allocated at display
+    bool display_full;                    // display is full size (see display_plane_t)
+    page_set_t owned;                     // which pages of ram are valid
+    const chip8_t *owner;                 // machine the checkpoint was taken from
+    uint32_t serial;                      // owner->checkpoint_serial when taken
+} chip8_checkpoint_t;
+
+#define PROFILE_MAX_DEPTH 64               // shadow call stack; deeper calls are not tracked
+#define PROFILE_MAX_NODES 4096            // distinct call paths
+
+// one distinct call path: a subroutine reached through its parent's path
+typedef struct {
+    uint16_t addr;                        // subroutine address (ROM entry for the root)
+    uint32_t parent;
+    uint32_t first_child;                 // 0 = none; node 0 is the root so never a child
+    uint32_t next_sibling;
+    uint64_t self;                        // instructions executed in this path itself
+} profile_node_t;
+
+// shadow call stack entry, maintained from 2NNN/00EE
+typedef struct {
+    uint32_t node;
+    uint64_t start;                       // cycle the call returned control to the callee
+} profile_frame_t;
 
-#ifdef DEBUG
-void print_debug_info(chip8_t *chip8)
-{
-    printf("Address: 0x%04X, Opcode: 0x%04X, Desc: ", chip8->PC - 2, chip8->inst.opcode);
+// execution counts gathered by emulate_instructions_profiled and the profiled steps
+typedef struct {
+    uint64_t pc[RAM_SIZE];                // executions per instruction address
+    uint64_t op_class[16];                // executions per opcode class (top nibble)
+    uint64_t total;                       // instructions profiled
+
+    uint64_t calls[RAM_SIZE];             // calls per subroutine address
+    uint64_t inclusive[RAM_SIZE];         // instructions inside a subroutine and its callees, per returned call
+    uint64_t exclusive[RAM_SIZE];         // instructions inside a subroutine itself
+    profile_node_t nodes[PROFILE_MAX_NODES];
+    uint32_t num_nodes;                   // 0 until the first instruction creates the root
+    profile_frame_t frames[PROFILE_MAX_DEPTH];
+    uint32_t depth;                       // frames in use; frames[depth - 1] is the current call
+    uint32_t untracked;                   // calls nested past PROFILE_MAX_DEPTH still open
+
+    uint32_t code[RAM_SIZE];              // instruction last executed per address (F000 NNNN: both words)
+    uint64_t code_generation[RAM_SIZE];   // mem_range_generation of its bytes then
+    uint64_t rewrites[RAM_SIZE];          // executions of an instruction changed since it last ran here
+    uint64_t total_rewrites;
+} chip8_profile_t;
+
+// one instruction with a platform's quirks compiled in; profile is ignored by the plain steps
+typedef void (*chip8_step_fn)(chip8_t *chip8, chip8_profile_t *profile);
+
+// interactive debugger state; breakpoints and watchpoints are one bit per address
+typedef struct {
+    uint64_t breakpoints[RAM_SIZE / 64];  // stop before executing at these PCs
+    uint64_t watchpoints[RAM_SIZE / 64];  // stop after an instruction writes these addresses
+    uint32_t armed;                       // bits set across both maps; 0 = no checks at all
+    bool attached;                        // pausing drops into the console prompt
+    bool skip_break;                      // resuming from a breakpoint: don't stop on it again
+    struct history *history;              // recorded run for reverse execution, or NULL
+} debugger_t;
+
+// a keypad change or timer tick of the recorded run, replayed at the same cycle
+typedef struct {
+    uint64_t cycle;                       // instructions executed when it happened
+    uint16_t keys;                        // keypad mask after a change
+    bool timer_tick;                      // update_timers ran (keys unused)
+} history_event_t;
+
+// checkpoints every few frames plus every input since the oldest, so any earlier
+// instruction can be reached again by restoring and re-executing
+typedef struct history {
+    chip8_checkpoint_t *checkpoints;      // ring of checkpoints, oldest at 'first'
+    uint64_t *checkpoint_event;           // absolute index of the first event after each checkpoint
+    uint32_t capacity;                    // checkpoints the memory budget allows
+    uint32_t first;
+    uint32_t count;
+    uint32_t spacing;                     // frames between checkpoints
+    uint32_t frames_since;                // frames since the last checkpoint
+    history_event_t *events;              // events since the oldest checkpoint
+    size_t num_events;
+    size_t events_capacity;
+    uint64_t events_base;                 // absolute index of events[0]
+    uint16_t keys;                        // keypad mask last logged
+} history_t;
+
+// log-linear histogram (HDR style): 16 linear sub-buckets per power of two, so any
+// recorded value is kept to within ~6%, from 0 up to the full uint64 range
+#define HIST_SUB_BITS 4
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
 
-    switch ((chip8->inst.opcode >> 12) & 0x0F)
-    {
-        case 0x00:                       // if the top 12 bits are zero
-            if (chip8->inst.NN == 0xE0)  // if the lowest 12 are
-            {
-                // 0x00E: Clear the screen
-                printf("Clear the screen.\n");
-            }
-            else if (chip8->inst.NN == 0xEE)
-            {   
-                // 0x00EE: Return from subroutine
-                printf("Return from subroutine to address 0x%04X.\n", *(chip8->stack_ptr - 1));
-            } 
-            else
-            {
-                printf("Unimplemented Opcode.\n");
-            }
-            break;
+typedef struct {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+} histogram_t;
+
+// live values for the metrics endpoint thread; only the main loop writes them,
+// so the endpoint reads without ever taking a lock the emulator waits on
+typedef struct {
+    _Atomic uint64_t instructions;
+    _Atomic uint64_t frames_emulated;
+    _Atomic uint64_t frames_presented;
+    _Atomic uint64_t frames_dropped;      // 60hz frames that went by without a present, beyond those skipped
+    _Atomic uint64_t frames_skipped;      // 60hz frames not drawn on purpose, see frame_skip_t
+    _Atomic uint64_t frame_skip;          // frames per present chosen at the last one
+    _Atomic uint64_t frame_p50;           // frame interval percentiles in us, published once a second
+    _Atomic uint64_t frame_p90;
+    _Atomic uint64_t frame_p99;
+    _Atomic uint64_t pacing_p50;          // pacing error percentiles in us, likewise
+    _Atomic uint64_t pacing_p99;
+    _Atomic uint64_t ips;                 // instructions per second over the last period
+    _Atomic int state;                    // emulator_state_t
+} metrics_live_t;
+
+// per frame timings of the main loop, in microseconds
+typedef struct {
+    histogram_t frame;                    // present to present interval
+    histogram_t emulate;                  // running the frame's instructions
+    histogram_t render;                   // drawing the display
+    histogram_t present;                  // SDL_RenderPresent
+    histogram_t overshoot;                // time slept past the requested delay
+    histogram_t instructions;             // instructions executed per frame (a count)
+    histogram_t pacing;                   // how much the wait from emulation to screen changed between presents
+    uint64_t frames;
+    uint64_t skipped;                     // frames emulated but not drawn
+    uint32_t frame_skip;                  // frames per present chosen at the last one
+    uint32_t skipped_since_present;
+    uint64_t period_start;                // performance counter at the last periodic report
+    uint64_t period_frames;               // frames since then
+    uint64_t period_presents;             // presents since then
+    uint64_t period_instructions;         // instructions since then
+    uint64_t last_present;                // performance counter at the previous present
+    uint64_t last_shown;                  // emulation time on screen since then, see metrics_pacing
+    int64_t latency;                      // and how long after that time it was presented
+    metrics_live_t live;
+} metrics_t;
+
+// adaptive frame skip: the machine always runs 60 frames and their instructions a second, but
+// when drawing can't keep up only every Nth frame is drawn and presented. N is picked so one
+// render fits in the time N frames leave over after emulating, up to MAX_FRAME_SKIP
+typedef struct {
+    double emulate_ms;                    // moving averages of a frame's emulation
+    double render_ms;                     // and of drawing plus presenting it
+    uint32_t every;                       // present every Nth frame
+    uint32_t since_present;               // frames emulated since the last present
+} frame_skip_t;
+
+// --vsync: presents follow the display's refresh instead of the 60hz schedule and show the latest
+// frame the emulator's own 60hz clock has completed, so on a 144hz panel a frame stays up for 2 or
+// 3 refreshes. --blend crossfades the last two frames by where the refresh falls between them
+typedef struct {
+    SDL_Texture *frames[2];               // the last two completed frames, composited
+    SDL_Rect used[2];                     // part of each texture in use (lo-res or hi-res)
+    uint8_t latest;                       // which of frames[] is the newer
+    bool blend;
+    uint64_t frame_ticks;                 // the emulator's 60hz period
+    uint64_t refresh_ticks;               // the display's: its mode's rate, then measured from presents
+    uint64_t completed;                   // when the latest frame completed, on the emulator's clock
+    uint64_t vblank;                      // when the coming present is expected to reach the screen
+    uint64_t last_present;
+} display_pacer_t;
+
+// lanes per batch; 8/16/32 fill an AVX2/AVX-512 register with byte registers
+#ifndef BATCH_LANES
+#define BATCH_LANES 16
+#endif
 
-        case 0x01:
-            // 0x1NNN: Jump to address NNN
-            printf("Jump to address NNN (0x%02X)\n", chip8->inst.NNN);
-            break;
+// DXYNs a deferring lane holds before it draws them anyway
+#define DEFERRED_DRAWS 32
 
-        case 0x02:
-            // 0x2NNN: Call subroutine at NNN
-            break;
+// a DXYN recorded to be drawn later; memory and the resolution stay as they were until it is
+typedef struct {
+    uint16_t I;
+    uint8_t VX, VY, N;
+    uint8_t planes;                       // planes it draws on: 1 outside XO-CHIP
+} deferred_draw_t;
 
-        case 0x03:
-            // 0x3XNN: Check if VX == NN, if so, skip the next instruction
-            printf("Check if V%X (0x%02X) == NN (0x%02X), skip next instruction if true.\n", chip8->inst.X, chip8->V[chip8->inst.X], chip8->inst.NN);
-            break;
+// a lane's recorded draws, oldest first
+typedef struct {
+    deferred_draw_t draw[DEFERRED_DRAWS];
+    uint8_t count;
+    bool vf_pending;                      // VF is the last draw's collision flag, not yet worked out
+    uint64_t keys;                        // draw_key bits of all but the last draw, so most skip looking for a twin
+} draw_list_t;
+
+// many chip8 machines running the same ROM, laid out struct-of-arrays
+// so each register is one contiguous row across all lanes
+typedef struct {
+    uint8_t V[16][BATCH_LANES];           // Data registers V0 to VF, per lane
+    uint16_t I[BATCH_LANES];              // Index register, per lane
+    uint16_t PC[BATCH_LANES];             // Program counter, per lane
+    uint8_t delay_timer[BATCH_LANES];     // Decrements at 60hz when >0
+    uint8_t sound_timer[BATCH_LANES];     // Decrements at 60hz when >0
+    uint16_t stack[STACK_DEPTH][BATCH_LANES]; // Subroutine stack, per lane
+    uint8_t stack_ptr[BATCH_LANES];       // Stack index, per lane; wraps at STACK_DEPTH
+    uint8_t fault[BATCH_LANES];           // chip8_fault_t bits, per lane
+    bool exited[BATCH_LANES];             // lane ran SCHIP 00FD, where a machine would go to QUIT
+    chip8_platform_t platform;            // shared by every lane, like the ROM
+    uint32_t rng[BATCH_LANES];            // CXNN random state, per lane
+    uint16_t opcode[BATCH_LANES];         // Opcode fetched by each lane this step
+    bool keypad[BATCH_LANES][16];         // Hexadecimal keypad, per lane
+    chip8_mem_t mem[BATCH_LANES];         // Memory, per lane; all lanes share the ROM image
+    display_plane_t *display[BATCH_LANES]; // Display planes, per lane; allocated by init_chip8_batch
+    uint8_t display_planes;               // planes in each lane's display
+    bool display_full;                    // each lane's display is full size (see display_plane_t)
+    uint8_t display_written[BATCH_LANES]; // bit per display band changed since the last incremental hash
+    bool hires[BATCH_LANES];              // SCHIP 128x64 mode, per lane
+    uint8_t planes[BATCH_LANES];          // XO-CHIP FN01 plane selection, per lane
+    uint8_t rpl[BATCH_LANES][RPL_FLAGS];  // SCHIP user flags, per lane
+    bool defer_draws;                     // record DXYN and draw only when needed, see draw_list_flush
+    draw_list_t draws[BATCH_LANES];       // recorded draws, per lane
+} chip8_batch_t;
+
+// per page and per display band hashes kept between incremental state hashes
+typedef struct {
+    uint64_t ram[RAM_PAGES];
+    uint64_t display[DISPLAY_BANDS];
+    bool valid;                           // false: rehash everything on the next call
+} hash_cache_t;
 
-         case 0x04:
-            // 0x4XNN: Check if VX != NN, if so, skip the next instruction
-            printf("Check if V%X (0x%02X) != NN (0x%02X), skip next instruction if true.\n", chip8->inst.X, chip8->V[chip8->inst.X], chip8->inst.NN);
-            break;
-            
-        case 0x05:
-            // 0x5XY0: Check if VX == VY, if so, skip next instruction
-            printf("Check if V%X (0x%02X) == V%X (0x%02X), skip next instruction if true.\n", chip8->inst.X, chip8->V[chip8->inst.X], chip8->inst.Y, chip8->V[chip8->inst.Y]);
-            break;
+// - - - - - - - -
+// DISASSEMBLY
+// - - - - - - - -
 
-        case 0x06:
-            // 0x6XNN: Set register VX to NN
-            // V offset by X
-            printf("Set register V%X to NN (0x%02X)\n", chip8->inst.X, chip8->inst.NN);
-            break;
+static const opcode_info_t opcode_table[NUM_OPCODES] = {
+#define OPCODE_INFO(handler, mask, match, mnemonic, operands, description) \
+    [OP_##handler] = { mask, match, mnemonic, operands, description },
+    CHIP8_OPCODES(OPCODE_INFO)
+#undef OPCODE_INFO
+    [OP_INVALID] = { 0x0000, 0x0000, "DW", "{OPCODE}", "Unimplemented Opcode." },
+};
 
-        case 0x07:
-            // 0x7XNN: Set register VX += NN
-            printf("Set register V%X (0x%02x) += NN (0x%02X). Result: 0x%02X\n", chip8->inst.X, chip8->V[chip8->inst.X], chip8->inst.NN, chip8->V[chip8->inst.X] + chip8->inst.NN);
-            break;
+// opcode_id lookup, keyed by top nibble and low byte; X and Y never select an instruction
+static uint8_t opcode_ids[16 * 256];
+static atomic_int opcode_ids_state;       // 0 unbuilt, 1 building, 2 ready
 
-        case 0x08:
-            switch (chip8->inst.N)
-            {
-                case 0:
-                    // 0x8XY0: Set register VX = VY
-                    printf("Set register V%X = V%X (0x%02X)\n", chip8->inst.X, chip8->inst.Y, chip8->V[chip8->inst.Y]);
-                    break;
+// build the lookup from the table once; safe to call from any thread, cheap after the first
+void decode_init(void)
+{
+    if (atomic_load_explicit(&opcode_ids_state, memory_order_acquire) == 2) return;
 
-                case 1:
-                    // 0x8XY1: Set register VX |= VY
-                    printf("Set register V%X (0x%02X) |= V%X (0x%02X). Result: 0x%02X\n", chip8->inst.X, chip8->V[chip8->inst.X], chip8->inst.Y, chip8->V[chip8->inst.Y], chip8->V[chip8->inst.X] | chip8->V[chip8->inst.Y]); 
-                    break;
+    int expected = 0;
+    if (!atomic_compare_exchange_strong(&opcode_ids_state, &expected, 1))
+    {
+        while (atomic_load_explicit(&opcode_ids_state, memory_order_acquire) != 2) ;
+        return;
+    }
 
-                case 2:
-                    // 0x8XY2: Set register VX &= VY
-                    printf("Set register V%X (0x%02X) &= V%X (0x%02X). Result: 0x%02X\n", chip8->inst.X, chip8->V[chip8->inst.X], chip8->inst.Y, chip8->V[chip8->inst.Y], chip8->V[chip8->inst.X] & chip8->V[chip8->inst.Y]); 
-                    break;
+    for (uint32_t key = 0; key < sizeof opcode_ids; key++)
+    {
+        const uint16_t opcode = ((key & 0xF00) << 4) | (key & 0xFF);
+        uint8_t id = OP_INVALID;
+        for (uint8_t op = 0; op < OP_INVALID && id == OP_INVALID; op++)
+        {
+            if ((opcode & opcode_table[op].mask) == opcode_table[op].match) id = op;
+        }
+        opcode_ids[key] = id;
+    }
+    atomic_store_explicit(&opcode_ids_state, 2, memory_order_release);
+}
 
-                case 3:
-                    // 0x8XY3: Set register VX ^= VY
-                    printf("Set register V%X (0x%02X) ^= V%X (0x%02X). Result: 0x%02X\n", chip8->inst.X, chip8->V[chip8->inst.X], chip8->inst.Y, chip8->V[chip8->inst.Y], chip8->V[chip8->inst.X] ^ chip8->V[chip8->inst.Y]); 
-                    break;
+// which table entry an opcode is; decode_init must have run (init_chip8_shared does it)
+static inline opcode_id_t opcode_id(uint16_t opcode)
+{
+    return opcode_ids[((opcode >> 4) & 0xF00) | (opcode & 0xFF)];
+}
 
-                case 4:
-                    // 0x8XY4: Set register VX += VY, set VF to 1 if carry, 0 if not
-                    printf("Set register V%X (0x%02X) += V%X (0x%02X), VF = 1 if carry; Result: 0x%02X, VF = %X\n", chip8->inst.X, chip8->V[chip8->inst.X], chip8->inst.Y, chip8->V[chip8->inst.Y], chip8->V[chip8->inst.X] + chip8->V[chip8->inst.Y], ((uint16_t)(chip8->V[chip8->inst.X] + chip8->V[chip8->inst.Y]) > 255));
-                    break;
+static char *put_hex(char *out, uint32_t value, uint8_t digits)
+{
+    for (int8_t d = digits - 1; d >= 0; d--) *out++ = "0123456789ABCDEF"[(value >> (d * 4)) & 0xF];
+    return out;
+}
 
-                case 5:
-                    // 0x8XY5: Set register VX -= VY, set VF to 1 if there is not a borrow (result is positive)
-                    printf("Set register V%X (0x%02X) -= V%X (0x%02X), VF = 1 if no borrow; Result: 0x%02X, VF = %X\n", chip8->inst.X, chip8->V[chip8->inst.X], chip8->inst.Y, chip8->V[chip8->inst.Y], chip8->V[chip8->inst.X] - chip8->V[chip8->inst.Y], (chip8->V[chip8->inst.Y] <= chip8->V[chip8->inst.X]));
-                    break;
+// expand an opcode_table template for one opcode; returns the length written
+size_t format_opcode(const char *template, uint16_t opcode, char *buf, size_t size)
+{
+    char *out = buf;
+    char *const end = buf + size - 1;
 
-                case 6:
-                    // 0x8XY6: Set register VX >>= 1, store shifted off bit in VF
-                    printf("Set register V%X (0x%02X) >>= 1, VF = shifted off bit (%X); Result: 0x%02X\n", chip8->inst.X, chip8->V[chip8->inst.X], chip8->V[chip8->inst.X] & 1, chip8->V[chip8->inst.X] >> 1);
-                    break;
+    for (const char *t = template; *t && end - out > 8; t++)
+    {
+        if (*t != '{')
+        {
+            *out++ = *t;
+            continue;
+        }
 
-                case 7:
-                    // 0x8XY7: Set register VX = VY - VX. set VF to 1 if there is not a borrow (result is positive)
-                    printf("Set register V%X = V%X (0x%02X) - V%X (0x%02X), VF = 1 if no borrow; Result: 0x%02X, VF = %X\n", chip8->inst.X, chip8->inst.Y, chip8->V[chip8->inst.Y], chip8->inst.X, chip8->V[chip8->inst.X], chip8->V[chip8->inst.Y] - chip8->V[chip8->inst.X], (chip8->V[chip8->inst.X] <= chip8->V[chip8->inst.Y]));
-                    break;
+        const char *field = ++t;
+        while (*t && *t != '}') t++;
+        const size_t len = t - field;
+        if (!*t) break;
 
-                case 0xE:
-                    // 0x8XY8: Set register VX <<= 1, store shifted off bit in VF
-                    printf("Set register V%X (0x%02X) <<= 1, VF = shifted off bit (%X); Result: 0x%02X\n", chip8->inst.X, chip8->V[chip8->inst.X], (chip8->V[chip8->inst.X] & 0x80) >> 7, chip8->V[chip8->inst.X] << 1);
-                    break;
+        if (len == 1 && *field == 'X') out = put_hex(out, opcode >> 8, 1);
+        else if (len == 1 && *field == 'Y') out = put_hex(out, opcode >> 4, 1);
+        else if (len == 1 && *field == 'N') out += snprintf(out, 3, "%u", opcode & 0x0F);
+        else
+        {
+            // NN, NNN and OPCODE are hex constants
+            const uint8_t digits = len == 2 ? 2 : len == 3 ? 3 : 4;
+            *out++ = '0';
+            *out++ = 'x';
+            out = put_hex(out, opcode, digits);
+        }
+    }
+    *out = '\0';
+    return out - buf;
+}
 
-                default:
-                    // wrong/unimplemented opcode
-                    break;
-            }
-            break;
+// describe an opcode in words; shared by trace decoding and tooling
+void disassemble_instruction(uint16_t opcode, char *buf, size_t size)
+{
+    decode_init();
+    format_opcode(opcode_table[opcode_id(opcode)].description, opcode, buf, size);
+}
 
-        case 0x09:
-            // 0x9XY0: Check if VX != VY; skip next instruction if so
-            printf("Check if V%X (0x%02X) != V%X (0x%02X), skip next instruction if true.\n", chip8->inst.X, chip8->V[chip8->inst.X], chip8->inst.Y, chip8->V[chip8->inst.Y]);
-            break;
+// assembler syntax for an opcode, e.g. "DRW V1, V2, 5"
+size_t disassemble_mnemonic(uint16_t opcode, char *buf, size_t size)
+{
+    decode_init();
+    const opcode_info_t *info = &opcode_table[opcode_id(opcode)];
+    size_t len = snprintf(buf, size, "%-5s", info->mnemonic);
+    if (len < size) len += format_opcode(info->operands, opcode, buf + len, size - len);
+    while (len > 0 && buf[len - 1] == ' ') buf[--len] = '\0';
+    return len;
+}
 
-        case 0x0A:
-            // 0XANNN: Set index register I to NNN
-            printf("Set I to NNN (0x%04X).\n", chip8->inst.NNN);
-            break;
+// - - - - - - - -
+// IFDEF
+// - - - - - - - -
 
-        case 0x0B:
-            // 0xBNNN: Jump to V0 + NNN
-            printf("Set PC to V0 (0x%02X) + NNN (0x%04X). Result PC = 0x%04X\n", chip8->V[0], chip8->inst.NNN, chip8->V[0] + chip8->inst.NNN);
-            break;
+// on-disk trace format: this header, then trace_entry_t records back to back
+#define TRACE_MAGIC "CH8TRACE"
+#define TRACE_VERSION 1
 
-        case 0x0C:
-            // 0xCXNN: Set register VX = rand() % 256 & NN (bitwise AND)
-            printf("Set V%X = (rand() %% 256) & NN (0x%02x)\n", chip8->inst.X, chip8->inst.NN);
-            break;
+// one executed instruction, 32 bytes
+typedef struct {
+    uint64_t cycle;                       // instructions executed before this one
+    uint16_t PC;                          // address of the instruction
+    uint16_t opcode;
+    uint16_t I;                           // I after the instruction
+    uint16_t V_changed;                   // bit per register the instruction changed
+    uint8_t V[16];                        // registers after the instruction
+} trace_entry_t;
 
-        case 0x0D:
-            // 0xDXYN: Draw N-height sprite at coordinate X,Y
-            printf("Draw N (%u) height sprite at coords V%X (0x%02X), V%X (0x%02X) from memory location I (0x%04X). Set VF = 1 if any pixels are turned off.\n", chip8->inst.N, chip8->inst.X, chip8->V[chip8->inst.X], chip8->inst.Y, chip8->V[chip8->inst.Y], chip8->I);
-            break;
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t entry_size;
+} trace_header_t;
 
-        case 0x0E:
-            if (chip8->inst.NN == 0x09E)
-            {
-                // 0xEX9E: Skip next instruction if key in VX is pressed
-                printf("Skip next instruction if key in V%X (0x%02X) is pressed. Keypad value:  %d\n", chip8->inst.X, chip8->V[chip8->inst.X], chip8->keypad[chip8->inst.X]);
-            }
-            else if (chip8->inst.NN == 0xA1)
-            {
-                // 0xEX9E: Skip next instruciton if key in VX is not pressed
-                 printf("Skip next instruction if key in V%X (0x%02X) is not pressed. Keypad value:  %d\n", chip8->inst.X, chip8->V[chip8->inst.X], chip8->keypad[chip8->inst.X]);
-            }
-            break;
+#ifdef DEBUG
+#define TRACE_ENTRIES (1u << 16)          // 2MB ring; power of 2 so indices wrap with a mask
 
-        case 0x0F:
-            switch (chip8->inst.NN)
-            {
-                case 0x0A:
-                    // 0xFX0A : VX = get_key(); Await until a keypress, and store in VX
-                    printf("Await until a key is pressed. Store key in V%X\n", chip8->inst.X);
-                    break;
+// single producer (emulation) / single consumer (writer thread) ring; when the writer
+// falls behind, new entries are dropped and counted rather than stalling emulation
+typedef struct {
+    trace_entry_t ring[TRACE_ENTRIES];
+    _Atomic uint32_t head;                // next slot the emulator writes
+    _Atomic uint32_t tail;                // next slot the writer flushes
+    _Atomic bool running;                 // writer thread keeps going while set
+    bool enabled;                         // runtime toggle, read once per instruction
+    uint64_t dropped;
+    FILE *file;
+    SDL_Thread *writer;
+} trace_t;
+
+static trace_t trace;
+
+static inline void trace_record(const chip8_t *chip8, uint16_t PC, const uint8_t *V_before)
+{
+    const uint32_t head = atomic_load_explicit(&trace.head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&trace.tail, memory_order_acquire) >= TRACE_ENTRIES)
+    {
+        trace.dropped++;
+        return;
+    }
 
-                case 0x1E:
-                    // 0xFX1E: Set I += VX; Add VX to register I. 
-                    printf("I (0x%04X) += V%X (0x%02X). Result (I): 0x%04X\n", chip8->I, chip8->inst.X, chip8->V[chip8->inst.X], chip8->I + chip8->V[chip8->inst.X]);
-                    break;
+    trace_entry_t *e = &trace.ring[head & (TRACE_ENTRIES - 1)];
+    e->cycle = chip8->cycles - 1;
+    e->PC = PC;
+    e->opcode = chip8->inst.opcode;
+    e->I = chip8->I;
+    e->V_changed = 0;
+    for (uint8_t i = 0; i < 16; i++) e->V_changed |= (uint16_t)(V_before[i] != chip8->V[i]) << i;
+    memcpy(e->V, chip8->V, sizeof e->V);
 
-                case 0x07:
-                    // 0xFX07: Set VX = delay timer
-                    printf("Set V%X = delay timer value (0x%02X)\n", chip8->V[chip8->inst.X], chip8->delay_timer);
-                    break;
+    atomic_store_explicit(&trace.head, head + 1, memory_order_release);
+}
 
-                case 0x15:
-                    // 0xFX15: Set delay timer = VX
-                    printf("Set delay timer value (0x%02X) = V%X\n", chip8->delay_timer, chip8->V[chip8->inst.X]);
-                    break;
+// write everything between tail and head to the trace file
+static void trace_flush(void)
+{
+    const uint32_t head = atomic_load_explicit(&trace.head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&trace.tail, memory_order_relaxed);
 
-                case 0x18:
-                    // 0xFX18: Set sound timer = VX
-                    printf("Set sound timer value (0x%02X) = V%X\n", chip8->sound_timer, chip8->V[chip8->inst.X]);
-                    break;
+    while (tail != head)
+    {
+        // contiguous run up to the end of the ring
+        const uint32_t start = tail & (TRACE_ENTRIES - 1);
+        uint32_t count = head - tail;
+        if (count > TRACE_ENTRIES - start) count = TRACE_ENTRIES - start;
+
+        fwrite(&trace.ring[start], sizeof(trace_entry_t), count, trace.file);
+        tail += count;
+        atomic_store_explicit(&trace.tail, tail, memory_order_release);
+    }
+}
 
-                case 0x29:
-                    // 0xFX29: Set register I to sprite location in memory for character in VX (0x0 to 0xF)
-                    printf("Set I to sprite location in memory for character in V%X (0x%02X). Result (VX*5) = (0x%02X)\n", chip8->inst.X, chip8->V[chip8->inst.X], chip8->V[chip8->inst.X] * 5);
-                    break;
+static int trace_writer(void *unused)
+{
+    (void)unused;
+    while (atomic_load(&trace.running))
+    {
+        trace_flush();
+        SDL_Delay(5);
+    }
+    trace_flush();
+    return 0;
+}
 
-                case 0x33:
-                    // 0xFX33: Store BCD representation of VX at memory offset from I
-                    printf("Store BCD representation of V%X (0x%02X) at memory from I (0x%04X)\n", chip8->inst.X, chip8->V[chip8->inst.X], chip8->I);
-                    break;
+// open the trace file and start the background writer; recording starts when enabled
+bool trace_open(const char *path, bool enabled)
+{
+    trace.file = fopen(path, "wb");
+    if (!trace.file)
+    {
+        SDL_Log("Could not open trace file %s\n", path);
+        return false;
+    }
 
-                case 0x55:
-                    // 0xFX55: Register dump V0-VX inclusive to memory offset from I.
-                    // SCHIP does not increment I, CHIP8 does increment I
-                    printf("Register dump V0-V%X (0x%02X) inclusive at memory from I (0x%04X)\n", chip8->inst.X, chip8->V[chip8->inst.X], chip8->I);
-                    break;
+    trace_header_t header = { .version = TRACE_VERSION, .entry_size = sizeof(trace_entry_t) };
+    memcpy(header.magic, TRACE_MAGIC, sizeof header.magic);
+    fwrite(&header, sizeof header, 1, trace.file);
 
-                case 0x65:
-                    // 0xFX55: Register load V0-VX inclusive to memory offset from I.
-                    // SCHIP does not increment I, CHIP8 does increment I
-                    printf("Register load V0-V%X (0x%02X) inclusive at memory from I (0x%04X)\n", chip8->inst.X, chip8->V[chip8->inst.X], chip8->I);
-                    break;
+    atomic_store(&trace.running, true);
+    trace.writer = SDL_CreateThread(trace_writer, "trace writer", NULL);
+    trace.enabled = enabled;
+    return true;
+}
 
-                default:    
-                    // unimplemented or invalid opcode
-                    break;
-            }
-            break;
+void trace_close(void)
+{
+    if (!trace.file) return;
 
-        default:    
-            printf("Unimplemented Opcode.\n");
-            break;                        // unimplemented or invalid opcode
-    }
+    trace.enabled = false;
+    atomic_store(&trace.running, false);
+    SDL_WaitThread(trace.writer, NULL);
+    fclose(trace.file);
+    trace.file = NULL;
+
+    if (trace.dropped) SDL_Log("Trace dropped %llu entries\n", (unsigned long long)trace.dropped);
 }
 #endif
 
@@ -270,18 +778,25 @@ void print_debug_info(chip8_t *chip8)
 // VARS
 // - - - - - - - - -
 
-uint8_t WINDOW_WIDTH = 64;                // O.G. value
-uint8_t WINDOW_HEIGHT = 32;               // O.G. value
+uint8_t WINDOW_WIDTH = 64;                // O.G. value; lo-res pixels across the window
+uint8_t WINDOW_HEIGHT = 32;               // O.G. value; hi-res pixels are half a lo-res pixel
 uint32_t FG_COLOUR = 0xFFFFFFFF;          // RGBA8888, WHITE
 uint32_t BG_COLOUR = 0x000000FF;          // RGBA8888, BLACK
-int SCALE_FACTOR = 4;                     // 4* = 264 by 128 resolution
+uint32_t PLANE_COLOURS[16] = {            // RGBA8888 by XO-CHIP plane bits (plane 0 lowest); 0 and 1 follow BG/FG
+    0x000000FF, 0xFFFFFFFF, 0xFF5555FF, 0xFFAA55FF, 0x55FF55FF, 0x55FFAAFF, 0x5555FFFF, 0xAA55FFFF,
+    0x555555FF, 0xAAAAAAFF, 0xAA0000FF, 0xAA5500FF, 0x00AA00FF, 0x00AAAAFF, 0x0000AAFF, 0xAA00AAFF,
+};
+int SCALE_FACTOR = 4;                     // 4* = 256 by 128 resolution
 uint32_t INSTRUCTS_PER_SECOND = 700;      // CHIP8 CPU clock rate
+bool STATS_OVERLAY = false;               // F2: frame timings shown in the window title
+uint32_t MAX_FRAME_SKIP = 4;              // most frames per present under load; 1 draws every frame
 
 // - - - - - - - - -
 // HELPER METHODS
 // - - - - - - - - - 
 
-bool init_sdl(SDL_Window **window, SDL_Renderer **renderer)
+// vsync: ask for presents that wait for the display's refresh; the renderer may not grant it
+bool init_sdl(SDL_Window **window, SDL_Renderer **renderer, bool vsync)
 {
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) != 0)
     {
@@ -295,7 +810,7 @@ bool init_sdl(SDL_Window **window, SDL_Renderer **renderer)
         SDL_Log("Unable to initalize SDL window: %s", SDL_GetError());
         return false;
     }
-    *renderer = SDL_CreateRenderer(*window, -1, SDL_RENDERER_ACCELERATED);
+    *renderer = SDL_CreateRenderer(*window, -1, SDL_RENDERER_ACCELERATED | (vsync ? SDL_RENDERER_PRESENTVSYNC : 0));
     if (!*renderer)
     {
         SDL_Log("Unable to initalize SDL renderer: %s", SDL_GetError());
@@ -322,45 +837,67 @@ void clear_screen(SDL_Renderer *renderer)
     SDL_RenderClear(renderer);
 }
 
-void update_screen(SDL_Renderer *renderer, const chip8_t chip8)
+// composite the display into a streaming texture the size of the hi-res screen, creating it on
+// first use; used is set to the part in use
+bool draw_display(SDL_Renderer *renderer, SDL_Texture **texture, const chip8_t *chip8, SDL_Rect *used)
 {
-    SDL_Rect rect = { .x = 0, .y = 0, .w = SCALE_FACTOR, .h = SCALE_FACTOR };
+    static uint32_t pixels[DISPLAY_HEIGHT][DISPLAY_WIDTH];
+    static uint32_t spread[256];          // byte of a plane row -> its 8 bits, one per nibble, leftmost lowest
 
-    // grab colour values to draw (FG)
-    const uint8_t fg_r = (FG_COLOUR >> 24) & 0xFF;
-    const uint8_t fg_g = (FG_COLOUR >> 16) & 0xFF;
-    const uint8_t fg_b = (FG_COLOUR >>  8) & 0xFF;
-    const uint8_t fg_a = (FG_COLOUR >>  0) & 0xFF;
-
-    // grab colour values to draw (BG)
-    const uint8_t bg_r = (BG_COLOUR >> 24) & 0xFF;
-    const uint8_t bg_g = (BG_COLOUR >> 16) & 0xFF;
-    const uint8_t bg_b = (BG_COLOUR >>  8) & 0xFF;
-    const uint8_t bg_a = (BG_COLOUR >>  0) & 0xFF;
-
-    // loop through display pixels, draw a rectangle per pixel to the SDL window
-    for (uint32_t i = 0; i < sizeof chip8.display; i++)
+    if (!*texture)
     {
-        // translate 1d index i to 2d x,y coord
-        rect.x = (i % WINDOW_WIDTH) * SCALE_FACTOR;
-        rect.y = (i / WINDOW_WIDTH) * SCALE_FACTOR;
-
-        if (chip8.display[i])
+        *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING,
+                                     DISPLAY_WIDTH, DISPLAY_HEIGHT);
+        if (!*texture)
         {
-            // pixel is on, draw FG colour
-            SDL_SetRenderDrawColor(renderer, fg_r, fg_g, fg_b, fg_a);
-            SDL_RenderFillRect(renderer, &rect);
+            SDL_Log("Unable to create display texture: %s", SDL_GetError());
+            return false;
         }
-        else
+    }
+    if (!spread[1])
+    {
+        for (uint32_t b = 0; b < 256; b++)
         {
-            // pixel is off, draw BG colour
-            SDL_SetRenderDrawColor(renderer, bg_r, bg_g, bg_b, bg_a);
-            SDL_RenderFillRect(renderer, &rect);
+            for (uint8_t i = 0; i < 8; i++) spread[b] |= (b >> (7 - i) & 1) << (4 * i);
         }
     }
 
-    // present the changes
-    SDL_RenderPresent(renderer);
+    // colour per pixel value, a bit from each plane; XO-CHIP's extra planes use PLANE_COLOURS
+    uint32_t lut[1 << DISPLAY_PLANES];
+    memcpy(lut, PLANE_COLOURS, sizeof lut);
+    lut[0] = BG_COLOUR;
+    lut[1] = FG_COLOUR;
+
+    const uint8_t width = chip8->hires ? DISPLAY_WIDTH : DISPLAY_WIDTH / 2;
+    const uint8_t height = chip8->hires ? DISPLAY_HEIGHT : DISPLAY_HEIGHT / 2;
+
+    // 8 pixels at a time: spread each plane's byte to nibbles and stack them into 8 pixel values
+    for (uint8_t y = 0; y < height; y++)
+    {
+        for (uint8_t x = 0; x < width; x += 8)
+        {
+            uint32_t values = 0;
+            for (uint8_t p = 0; p < chip8->display_planes; p++)
+            {
+                values |= spread[row_byte(row_get(chip8->display, p, y, chip8->display_full), x)] << p;
+            }
+            for (uint8_t i = 0; i < 8; i++) pixels[y][x + i] = lut[values >> (4 * i) & 0xF];
+        }
+    }
+
+    SDL_UpdateTexture(*texture, NULL, pixels, sizeof pixels[0]);
+    *used = (SDL_Rect){ .w = width, .h = height };
+    return true;
+}
+
+void update_screen(SDL_Renderer *renderer, const chip8_t chip8)
+{
+    // the part of the display in use is stretched over the window in one copy
+    static SDL_Texture *texture;
+    SDL_Rect used;
+    if (draw_display(renderer, &texture, &chip8, &used)) SDL_RenderCopy(renderer, texture, &used, NULL);
+
+    // presenting is left to the caller, so it can be timed separately
 }
 
 // - - - - - - - - -  - - - - - - - - -  - - - - - - - - - 
@@ -410,6 +947,22 @@ void handle_input(chip8_t *chip8)
                         }
                         return;
 
+#ifdef DEBUG
+                    case SDLK_F1:
+                        // toggle instruction tracing; opens chip8.trace if --trace wasn't given
+                        if (trace.file || trace_open("chip8.trace", false))
+                        {
+                            trace.enabled = !trace.enabled;
+                            printf("==== TRACE %s ====\n", trace.enabled ? "ON" : "OFF");
+                        }
+                        break;
+#endif
+
+                    case SDLK_F2:
+                        // toggle the frame timing overlay
+                        STATS_OVERLAY = !STATS_OVERLAY;
+                        break;
+
                     // map keyboard to chip8 keypad
                     case SDLK_1: chip8->keypad[0x1] = true; break;
                     case SDLK_2: chip8->keypad[0x2] = true; break;
@@ -471,428 +1024,3619 @@ void handle_input(chip8_t *chip8)
     }
 }
 
-bool init_chip8(chip8_t *chip8, char *rom_name)
+// - - - - - - - - -
+// MEMORY
+// - - - - - - - - -
+
+static inline bool page_test(const page_set_t *set, uint32_t p)
 {
-    const uint32_t entry_point = 0x200;  // CHIP8 Roms will be loaded to 0x200
+    return set->bits[p / 64] >> (p % 64) & 1;
+}
 
-    const uint8_t font[] = {
-        0xF0, 0x90, 0x90, 0x90, 0xF0,    // 0
-        0x20, 0x60, 0x20, 0x20, 0x70,    // 1  
-        0xF0, 0x10, 0xF0, 0x80, 0xF0,    // 2
-        0xF0, 0x10, 0xF0, 0x10, 0xF0,    // 3
-        0x90, 0x90, 0xF0, 0x10, 0x10,    // 4
-        0xF0, 0x80, 0xF0, 0x10, 0xF0,    // 5
-        0xF0, 0x80, 0xF0, 0x90, 0xF0,    // 6
-        0xF0, 0x10, 0x20, 0x40, 0x40,    // 7
-        0xF0, 0x90, 0xF0, 0x90, 0xF0,    // 8
-        0xF0, 0x90, 0xF0, 0x10, 0xF0,    // 9
-        0xF0, 0x90, 0xF0, 0x90, 0x90,    // A
-        0xE0, 0x90, 0xE0, 0x90, 0xE0,    // B
-        0xF0, 0x80, 0x80, 0x80, 0xF0,    // C
-        0xE0, 0x90, 0x90, 0x90, 0xE0,    // D
-        0xF0, 0x80, 0xF0, 0x80, 0xF0,    // E
-        0xF0, 0x80, 0xF0, 0x80, 0x80     // F
-    };
+static inline void page_add(page_set_t *set, uint32_t p)
+{
+    set->bits[p / 64] |= 1ull << (p % 64);
+}
 
-    // Load font
-    memcpy(&chip8->ram[0], font, sizeof(font));
+static inline void page_remove(page_set_t *set, uint32_t p)
+{
+    set->bits[p / 64] &= ~(1ull << (p % 64));
+}
 
-    // open ROM file
-    FILE *rom = fopen(rom_name, "rb");
-    if (!rom)
+static inline void page_fill(page_set_t *set, bool value)
+{
+    memset(set, value ? 0xFF : 0, sizeof *set);
+}
+
+// pages a machine can address; loops over pages stop here, so 4K machines only look at 16
+static inline uint32_t mem_pages(const chip8_mem_t *mem)
+{
+    return ((uint32_t)mem->mask + 1) / RAM_PAGE_SIZE;
+}
+
+// give mem a page table of pages entries, page pointers and generations in one block. Entries
+// it already had are kept; new ones point at the image. Private pages past the end are released
+static void mem_resize_table(chip8_mem_t *mem, uint32_t pages)
+{
+    const uint32_t had = mem->page ? mem_pages(mem) : 0;
+    for (uint32_t p = pages; p < had; p++)
     {
-        SDL_Log("Rom file %s is invalid or does not exist\n", rom_name);
-        return false;
+        if (page_test(&mem->owned, p)) free(mem->page[p]);
+        page_remove(&mem->owned, p);
+        page_remove(&mem->dirty, p);
     }
 
-    // get and check ROM size
+    uint8_t **page = malloc(pages * (sizeof *page + sizeof *mem->generation));
+    if (!page)
+    {
+        SDL_Log("Out of memory allocating the page table\n");
+        exit(EXIT_FAILURE);
+    }
+    uint32_t *generation = (uint32_t *)&page[pages];
+
+    for (uint32_t p = 0; p < pages; p++)
+    {
+        page[p] = p < had ? mem->page[p] : (uint8_t *)&mem->image->ram[p * RAM_PAGE_SIZE];
+        generation[p] = p < had ? mem->generation[p] : 0;
+    }
+    free(mem->page);
+    mem->page = page;
+    mem->generation = generation;
+}
+
+// point every page of mem at the shared image; the address space is 4K until mem_set_size
+void mem_init(chip8_mem_t *mem, const chip8_image_t *image)
+{
+    mem->page = NULL;
+    mem->image = image;
+    page_fill(&mem->owned, false);
+    page_fill(&mem->dirty, false);
+    page_fill(&mem->written, true);
+    mem->sprites = NULL;
+    mem_resize_table(mem, CHIP8_RAM_SIZE / RAM_PAGE_SIZE);
+    mem->mask = CHIP8_RAM_SIZE - 1;
+}
+
+// address space size, a power of two up to RAM_SIZE; addresses past it wrap around.
+// The page table follows, so a 4K machine only carries 16 entries
+void mem_set_size(chip8_mem_t *mem, uint32_t size)
+{
+    mem_resize_table(mem, size / RAM_PAGE_SIZE);
+    mem->mask = size - 1;
+    page_fill(&mem->written, true);
+
+    // cached sprites that wrapped at the old size would not at the new one
+    if (mem->sprites) memset(mem->sprites, 0, sizeof *mem->sprites);
+}
+
+// release private pages and the page table; mem falls back to nothing and must be re-initialized
+void mem_free(chip8_mem_t *mem)
+{
+    for (uint32_t p = 0; p < mem_pages(mem); p++)
+    {
+        if (page_test(&mem->owned, p)) free(mem->page[p]);
+    }
+    page_fill(&mem->owned, false);
+    free(mem->page);
+    mem->page = NULL;
+    mem->generation = NULL;
+    free(mem->sprites);
+    mem->sprites = NULL;
+}
+
+// make dst a copy of src: shared pages stay shared, private pages are duplicated
+void mem_clone(chip8_mem_t *dst, const chip8_mem_t *src)
+{
+    mem_init(dst, src->image);
+    mem_set_size(dst, (uint32_t)src->mask + 1);
+    for (uint32_t p = 0; p < mem_pages(src); p++)
+    {
+        if (!page_test(&src->owned, p)) continue;
+
+        uint8_t *page = malloc(RAM_PAGE_SIZE);
+        if (!page)
+        {
+            SDL_Log("Out of memory copying ram page 0x%X\n", p);
+            exit(EXIT_FAILURE);
+        }
+        memcpy(page, src->page[p], RAM_PAGE_SIZE);
+        dst->page[p] = page;
+        page_add(&dst->owned, p);
+    }
+}
+
+// first write to a shared page: give this instance its own copy
+void mem_own_page(chip8_mem_t *mem, uint32_t p)
+{
+    uint8_t *page = malloc(RAM_PAGE_SIZE);
+    if (!page)
+    {
+        SDL_Log("Out of memory copying ram page 0x%X\n", p);
+        exit(EXIT_FAILURE);
+    }
+    memcpy(page, mem->page[p], RAM_PAGE_SIZE);
+    mem->page[p] = page;
+    page_add(&mem->owned, p);
+}
+
+// addresses wrap at the machine's address space, so page lookups can't index past the page table
+static inline uint8_t mem_read(const chip8_mem_t *mem, uint16_t addr)
+{
+    addr &= mem->mask;
+    return mem->page[addr / RAM_PAGE_SIZE][addr % RAM_PAGE_SIZE];
+}
+
+static inline void mem_write(chip8_mem_t *mem, uint16_t addr, uint8_t val)
+{
+    addr &= mem->mask;
+    const uint32_t p = addr / RAM_PAGE_SIZE;
+    if (!page_test(&mem->owned, p)) mem_own_page(mem, p);
+    mem->page[p][addr % RAM_PAGE_SIZE] = val;
+    mem->generation[p]++;
+    page_add(&mem->dirty, p);
+    page_add(&mem->written, p);
+}
+
+// - write generations -
+// Every page counts the changes made to it (mem_write, checkpoint restores), so anything derived
+// from memory - decoded code, shifted sprites, snapshot deltas - can keep the count it was built
+// at and tell whether it is still current without looking at the bytes. Counts never go back
+// while mem lives; mem_init and mem_clone start them over
+
+// generation of the page holding addr
+static inline uint32_t mem_generation(const chip8_mem_t *mem, uint16_t addr)
+{
+    return mem->generation[(addr & mem->mask) / RAM_PAGE_SIZE];
+}
+
+// one count for every page [addr, addr + len) touches, wrapping like reads (an empty range is
+// addr's page). It is a sum of counts that only go up, so it moves whenever any of them does
+static inline uint64_t mem_range_generation(const chip8_mem_t *mem, uint16_t addr, uint32_t len)
+{
+    const uint32_t first = (addr & mem->mask) / RAM_PAGE_SIZE;
+    const uint32_t last = ((addr + (len ? len - 1 : 0)) & mem->mask) / RAM_PAGE_SIZE;
+
+    uint64_t sum = mem->generation[first];
+    for (uint32_t p = first; p != last; )
+    {
+        p = (p + 1) % mem_pages(mem);
+        sum += mem->generation[p];
+    }
+    return sum;
+}
+
+// xorshift32; the state lives in the machine so checkpoints and replays are deterministic
+static inline uint32_t chip8_rand(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+// - - - - - - - - -
+// PLATFORMS
+// - - - - - - - - -
+
+static const chip8_quirks_t platform_quirks[NUM_PLATFORMS] = {
+#define PLATFORM_QUIRKS(id, name, extension, ...) [PLATFORM_##id] = { __VA_ARGS__ },
+    CHIP8_PLATFORMS(PLATFORM_QUIRKS)
+#undef PLATFORM_QUIRKS
+};
+
+static const char *platform_names[NUM_PLATFORMS] = {
+#define PLATFORM_NAME(id, name, ...) [PLATFORM_##id] = name,
+    CHIP8_PLATFORMS(PLATFORM_NAME)
+#undef PLATFORM_NAME
+};
+
+// the platform a ROM's file extension names; CHIP8 for anything else
+chip8_platform_t platform_from_rom_name(const char *rom_name)
+{
+    const char *ext = rom_name ? strrchr(rom_name, '.') : NULL;
+#define PLATFORM_EXTENSION(id, name, extension, ...) if (ext && !strcmp(ext, extension)) return PLATFORM_##id;
+    CHIP8_PLATFORMS(PLATFORM_EXTENSION)
+#undef PLATFORM_EXTENSION
+    return PLATFORM_CHIP8;
+}
+
+// a file name with one of the platforms' ROM extensions
+bool is_rom_name(const char *name)
+{
+    const char *ext = strrchr(name, '.');
+#define PLATFORM_EXTENSION(id, name, extension, ...) if (ext && !strcmp(ext, extension)) return true;
+    CHIP8_PLATFORMS(PLATFORM_EXTENSION)
+#undef PLATFORM_EXTENSION
+    return false;
+}
+
+// --platform NAME
+bool parse_platform(const char *name, chip8_platform_t *platform)
+{
+    for (uint32_t p = 0; p < NUM_PLATFORMS; p++)
+    {
+        if (strcmp(name, platform_names[p])) continue;
+        *platform = p;
+        return true;
+    }
+    return false;
+}
+
+// resize a display to planes planes, full or not, keeping what it had and blanking the rest
+// (a display that isn't full is the start of a full one); *display NULL is a new display
+void display_resize(display_plane_t **display, uint8_t *have, bool *have_full, uint8_t planes, bool full)
+{
+    const size_t kept = *display ? display_bytes(*have, *have_full) : 0;
+    const size_t bytes = display_bytes(planes, full);
+    if (*display && kept == bytes)
+    {
+        *have = planes;
+        *have_full = full;
+        return;
+    }
+
+    display_plane_t *resized = realloc(*display, bytes);
+    if (!resized)
+    {
+        SDL_Log("Out of memory allocating the display\n");
+        exit(EXIT_FAILURE);
+    }
+    if (bytes > kept) memset((uint8_t *)resized + kept, 0, bytes - kept);
+    *display = resized;
+    *have = planes;
+    *have_full = full;
+}
+
+// the address space a platform runs in: all 64K for XO-CHIP, 4K for everything else
+uint32_t platform_ram_size(chip8_platform_t platform)
+{
+    return platform_quirks[platform].xochip ? RAM_SIZE : CHIP8_RAM_SIZE;
+}
+
+// run a machine as a platform; XO-CHIP also gets the whole 64K address space and all the display
+// planes, everything else 4K and one plane. Only SCHIP and XO-CHIP have hi-res, so only their
+// displays are full
+void set_platform(chip8_t *chip8, chip8_platform_t platform)
+{
+    chip8->platform = platform;
+    mem_set_size(&chip8->mem, platform_ram_size(platform));
+    display_resize(&chip8->display, &chip8->display_planes, &chip8->display_full,
+                   platform_quirks[platform].xochip ? DISPLAY_PLANES : 1, platform_quirks[platform].schip);
+}
+
+// one case per platform, each running SPECIALIZE(quirks) with that platform's quirks as
+// compile time constants; callers define SPECIALIZE around it. Selecting the platform is
+// the only runtime cost, so loops should switch once outside rather than per instruction
+#define PLATFORM_CASE(id, ...) case PLATFORM_##id: SPECIALIZE(platform_quirks[PLATFORM_##id]); break;
+#define DISPATCH_PLATFORM(platform) switch (platform) { CHIP8_PLATFORMS(PLATFORM_CASE) default: break; }
+
+// - - - - - - - - -
+// MACHINE SETUP
+// - - - - - - - - -
+
+// load the font and an in-memory ROM into a memory image that any number of instances can share;
+// the ROM has to fit the address space of the platform it will run as
+bool load_chip8_image_buffer(chip8_image_t *image, const uint8_t *rom, size_t rom_size, chip8_platform_t platform)
+{
+    const uint32_t entry_point = 0x200;  // CHIP8 Roms will be loaded to 0x200
+
+    const uint8_t font[] = {
+        0xF0, 0x90, 0x90, 0x90, 0xF0,    // 0
+        0x20, 0x60, 0x20, 0x20, 0x70,    // 1  
+        0xF0, 0x10, 0xF0, 0x80, 0xF0,    // 2
+        0xF0, 0x10, 0xF0, 0x10, 0xF0,    // 3
+        0x90, 0x90, 0xF0, 0x10, 0x10,    // 4
+        0xF0, 0x80, 0xF0, 0x10, 0xF0,    // 5
+        0xF0, 0x80, 0xF0, 0x90, 0xF0,    // 6
+        0xF0, 0x10, 0x20, 0x40, 0x40,    // 7
+        0xF0, 0x90, 0xF0, 0x90, 0xF0,    // 8
+        0xF0, 0x90, 0xF0, 0x10, 0xF0,    // 9
+        0xF0, 0x90, 0xF0, 0x90, 0x90,    // A
+        0xE0, 0x90, 0xE0, 0x90, 0xE0,    // B
+        0xF0, 0x80, 0x80, 0x80, 0xF0,    // C
+        0xE0, 0x90, 0x90, 0x90, 0xE0,    // D
+        0xF0, 0x80, 0xF0, 0x80, 0xF0,    // E
+        0xF0, 0x80, 0xF0, 0x80, 0x80     // F
+    };
+
+    // SCHIP 8x10 digits for FX30, placed right after the small font
+    const uint8_t big_font[] = {
+        0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF,    // 0
+        0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF,    // 1
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF,    // 2
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,    // 3
+        0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03,    // 4
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,    // 5
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF,    // 6
+        0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18,    // 7
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF,    // 8
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,    // 9
+        0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3,    // A
+        0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC,    // B
+        0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C,    // C
+        0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC,    // D
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF,    // E
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0     // F
+    };
+
+    // size check
+    const size_t max_size = platform_ram_size(platform) - entry_point;
+    if (rom_size > max_size)
+    {
+        SDL_Log("ROM is too large. ROM size: %d, Max Size allowed: %d\n", (int)rom_size, (int)max_size);
+        return false;
+    }
+
+    memset(image, 0, sizeof *image);
+
+    // Load fonts
+    memcpy(&image->ram[0], font, sizeof(font));
+    memcpy(&image->ram[BIG_FONT_ADDR], big_font, sizeof(big_font));
+
+    // Load ROM
+    memcpy(&image->ram[entry_point], rom, rom_size);
+    return true;
+}
+
+// load the font and a ROM file into a memory image
+bool load_chip8_image(chip8_image_t *image, char *rom_name, chip8_platform_t platform)
+{
+    // open ROM file
+    FILE *rom = fopen(rom_name, "rb");
+    if (!rom)
+    {
+        SDL_Log("Rom file %s is invalid or does not exist\n", rom_name);
+        return false;
+    }
+
+    // get and check ROM size
     fseek(rom, 0, SEEK_END);
     const size_t rom_size = ftell(rom);
-    const size_t max_size = sizeof chip8->ram - entry_point;
+    const size_t max_size = platform_ram_size(platform) - 0x200;
     rewind(rom);
 
-    // size check
-    if (rom_size > max_size)
+    // size check
+    if (rom_size > max_size)
+    {
+        SDL_Log("ROM file %s is too large. ROM size: %d, Max Size allowed: %d\n", rom_name, (int)rom_size, (int)max_size);
+        fclose(rom);
+        return false;
+    }
+
+    // Load ROM
+    uint8_t *data = malloc(rom_size ? rom_size : 1);
+    if (!data || (rom_size && fread(data, rom_size, 1, rom) != 1))
+    {
+        SDL_Log("Could not read ROM file %s into CHIP8 memory\n", rom_name);
+        free(data);
+        fclose(rom);
+        return false;
+    }
+
+    // close the stream
+    fclose(rom);
+
+    const bool loaded = load_chip8_image_buffer(image, data, rom_size, platform);
+    free(data);
+    return loaded;
+}
+
+// set up a machine on an already loaded image; the image must outlive the machine
+void init_chip8_shared(chip8_t *chip8, const chip8_image_t *image, char *rom_name)
+{
+    const uint32_t entry_point = 0x200;
+
+    decode_init();
+    mem_init(&chip8->mem, image);
+    chip8->display = NULL;              // sized by set_platform
+
+    // set chip8 machine defaults
+    chip8->state = RUNNING;             // default machine state
+    chip8->PC = entry_point;            // start program counter
+    chip8->rom_name = rom_name;         // rom name
+    chip8->stack_ptr = 0;               // empty stack
+    chip8->planes = 1;                  // XO-CHIP draws on plane 0 until FN01 says otherwise
+    set_platform(chip8, platform_from_rom_name(rom_name));
+    chip8->rng = 0x2545F491;            // fixed seed; main reseeds from the clock
+}
+
+// load a ROM and set up a machine on it, running as platform
+bool init_chip8(chip8_t *chip8, char *rom_name, chip8_platform_t platform)
+{
+    chip8_image_t *image = malloc(sizeof *image);
+    if (!image || !load_chip8_image(image, rom_name, platform))
+    {
+        free(image);
+        return false;
+    }
+
+    init_chip8_shared(chip8, image, rom_name);
+    set_platform(chip8, platform);
+    chip8->own_image = image;
+    return true;
+}
+
+// release private ram pages and the display, and the image if init_chip8 loaded it
+void free_chip8(chip8_t *chip8)
+{
+    mem_free(&chip8->mem);
+    free(chip8->display);
+    chip8->display = NULL;
+    free(chip8->own_image);
+    chip8->own_image = NULL;
+}
+
+// the interpreters and the helpers they call are specialized per platform and profiler by inlining
+#if defined(__GNUC__)
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
+
+// the bits of a display row in use: all of them in hi-res, the top (leftmost) half in lo-res
+static ALWAYS_INLINE display_row_t display_row_mask(bool hires)
+{
+    return (display_row_t){ ~0ull, hires ? ~0ull : 0 };
+}
+
+// display bands that rows [VY, VY + rows) touch; sprites clip at the bottom edge unless wrapped
+static ALWAYS_INLINE uint8_t display_bands(uint8_t VY, uint8_t rows, bool hires, bool wrap)
+{
+    const uint8_t height = hires ? DISPLAY_HEIGHT : DISPLAY_HEIGHT / 2;
+    const uint8_t Y = VY % height;
+    const uint8_t end = Y + rows < height ? Y + rows : height;
+    if (rows == 0) return 0;
+    uint8_t bands = (uint8_t)((2u << ((end - 1) / DISPLAY_BAND_ROWS)) - (1u << (Y / DISPLAY_BAND_ROWS)));
+    if (wrap && Y + rows > height) bands |= (uint8_t)((2u << ((Y + rows - height - 1) / DISPLAY_BAND_ROWS)) - 1);
+    return bands;
+}
+
+// rows a DXYN sprite covers: N, or 16 for an SCHIP DXY0 16x16 sprite
+static ALWAYS_INLINE uint8_t sprite_rows(uint8_t N, const chip8_quirks_t quirks)
+{
+    return N == 0 && quirks.schip ? 16 : N;
+}
+
+// display planes an instruction acts on: FN01's selection on XO-CHIP, plane 0 everywhere else
+static ALWAYS_INLINE uint8_t active_planes(uint8_t planes, const chip8_quirks_t quirks)
+{
+    return quirks.xochip ? planes : 1;
+}
+
+// an 8XYN flag into VF; with only_set (CHIP8's 8XY4) a clear flag leaves VF as it was
+static ALWAYS_INLINE void set_flag(chip8_t *chip8, uint8_t flag, bool only_set)
+{
+    if (flag || !only_set) chip8->V[0xF] = flag;
+}
+
+// the rows of the sprite at addr as they land on a display row at column X: shifted into place,
+// wrapped or clipped at the right edge and masked to the display in use. Served from the sprite
+// cache while the pages the data lives on are unwritten, else read from memory into it
+static ALWAYS_INLINE const display_row_t *shifted_sprite(chip8_mem_t *mem, uint16_t addr, uint8_t rows, bool wide,
+                                                         uint8_t X, bool hires, bool wrap,
+                                                         display_row_t scratch[SPRITE_MAX_ROWS])
+{
+    addr &= mem->mask;
+    const uint8_t row_bytes = wide ? 2 : 1;
+    const uint64_t generation = mem_range_generation(mem, addr, rows * row_bytes);
+    const uint8_t shape = rows | wide << 5 | hires << 6 | wrap << 7;
+
+    if (!mem->sprites) mem->sprites = calloc(1, sizeof *mem->sprites);
+    sprite_entry_t *entry = NULL;
+    if (mem->sprites)
+    {
+        entry = &mem->sprites->entry[((uint32_t)addr << 7 | X) * 0x9E3779B1u >> (32 - SPRITE_CACHE_BITS)];
+        if (entry->addr == addr && entry->X == X && entry->shape == shape && entry->generation == generation)
+        {
+            return entry->rows;
+        }
+    }
+
+    const uint8_t width = hires ? DISPLAY_WIDTH : DISPLAY_WIDTH / 2;
+    const display_row_t in_use = display_row_mask(hires);
+    display_row_t *out = entry ? entry->rows : scratch;
+    for (uint8_t i = 0; i < rows; i++)
+    {
+        // sprite row as the leftmost pixels of a row, then moved across to X
+        const uint16_t row_addr = addr + i * row_bytes;
+        const display_row_t sprite_data = {
+            wide ? (uint64_t)(mem_read(mem, row_addr) << 8 | mem_read(mem, row_addr + 1)) << 48
+                 : (uint64_t)mem_read(mem, row_addr) << 56, 0 };
+
+        // pixels past the right edge are dropped, or carry on from the left
+        display_row_t pixels = row_shr(sprite_data, X);
+        if (wrap && X) pixels = row_or(pixels, row_shl(sprite_data, width - X));
+        out[i] = row_and(pixels, in_use);
+    }
+
+    if (entry)
+    {
+        entry->addr = addr;
+        entry->X = X;
+        entry->shape = shape;
+        entry->generation = generation;
+    }
+    return out;
+}
+
+// where a DXYN sprite lands on the display
+typedef struct {
+    uint8_t X;                            // left column
+    uint8_t top;                          // first display row
+    uint8_t rows;                         // sprite rows
+    uint8_t visible;                      // rows drawn: the bottom edge clips them unless sprites wrap
+    bool wide;                            // SCHIP 16x16
+} sprite_place_t;
+
+static ALWAYS_INLINE sprite_place_t place_sprite(uint8_t VX, uint8_t VY, uint8_t N, bool hires,
+                                                 const chip8_quirks_t quirks)
+{
+    const uint8_t width = hires ? DISPLAY_WIDTH : DISPLAY_WIDTH / 2;
+    const uint8_t height = hires ? DISPLAY_HEIGHT : DISPLAY_HEIGHT / 2;
+    sprite_place_t at;
+    at.wide = N == 0 && quirks.schip;
+    at.rows = sprite_rows(N, quirks);
+    at.X = VX % width;
+    at.top = VY % height;
+
+    // Stop drawing the sprite where the bottom edge of screen is hit, or carry on from the top
+    at.visible = quirks.wrap_sprites || at.top + at.rows <= height ? at.rows : height - at.top;
+    return at;
+}
+
+// sprite data for plane p: with several planes selected each plane's data follows the last's
+static ALWAYS_INLINE uint16_t sprite_plane_data(uint16_t I, const sprite_place_t at, uint8_t planes, uint8_t p)
+{
+    uint8_t before = 0;
+    for (uint8_t q = 0; q < p; q++) before += (planes >> q) & 1;
+    return (uint16_t)(I + before * at.rows * (at.wide ? 2 : 1));
+}
+
+// XOR a sprite from memory at I onto each selected plane at (VX, VY), clipping at the edges, or
+// wrapping around them. Sprite rows come ready shifted from the sprite cache and are XORed into
+// display rows whole. Returns the new carry flag: 1 if any screen pixels were set off
+static ALWAYS_INLINE uint8_t draw_sprite(display_plane_t *display, chip8_mem_t *mem, uint16_t I,
+                                         uint8_t VX, uint8_t VY, uint8_t N, bool hires, uint8_t planes,
+                                         const chip8_quirks_t quirks)
+{
+    const uint8_t height = hires ? DISPLAY_HEIGHT : DISPLAY_HEIGHT / 2;
+    const sprite_place_t at = place_sprite(VX, VY, N, hires, quirks);
+
+    // any set bit: a screen pixel was set off
+    display_row_t carry = { 0, 0 };
+
+    for (uint8_t p = 0; p < DISPLAY_PLANES; p++)
+    {
+        if (!(planes & (1 << p))) continue;
+
+        display_row_t scratch[SPRITE_MAX_ROWS];
+        const display_row_t *sprite = shifted_sprite(mem, sprite_plane_data(I, at, planes, p), at.rows, at.wide,
+                                                     at.X, hires, quirks.wrap_sprites, scratch);
+
+        uint8_t Y = at.top;
+        for (uint8_t i = 0; i < at.visible; i++)
+        {
+            const display_row_t under = row_get(display, p, Y, quirks.schip);
+            carry = row_or(carry, row_and(under, sprite[i]));
+            row_put(display, p, Y, row_xor(under, sprite[i]), quirks.schip);
+            if (++Y >= height) Y = 0;
+        }
+    }
+
+    return row_any(carry);
+}
+
+// 00E0: clear the selected planes
+static ALWAYS_INLINE void clear_planes(display_plane_t *display, uint8_t planes, const chip8_quirks_t quirks)
+{
+    for (uint8_t p = 0; p < DISPLAY_PLANES; p++)
+    {
+        if (planes & (1 << p)) memset(&display[p], 0, display_bytes(1, quirks.schip));
+    }
+}
+
+// 00CN/00DN: scroll the selected planes down (positive) or up N rows; rows move whole,
+// and the N rows scrolled in come in blank
+static ALWAYS_INLINE void scroll_vertical(display_plane_t *display, int8_t rows, bool hires, uint8_t planes,
+                                          const chip8_quirks_t quirks)
+{
+    const int8_t height = hires ? DISPLAY_HEIGHT : DISPLAY_HEIGHT / 2;
+    const display_row_t blank = { 0, 0 };
+    for (uint8_t p = 0; p < DISPLAY_PLANES; p++)
+    {
+        if (!(planes & (1 << p))) continue;
+        if (rows > 0)
+        {
+            for (int8_t y = height - 1; y >= 0; y--)
+            {
+                row_put(display, p, y, y >= rows ? row_get(display, p, y - rows, quirks.schip) : blank, quirks.schip);
+            }
+        }
+        else
+        {
+            for (int8_t y = 0; y < height; y++)
+            {
+                row_put(display, p, y, y - rows < height ? row_get(display, p, y - rows, quirks.schip) : blank,
+                        quirks.schip);
+            }
+        }
+    }
+}
+
+// 00FB/00FC: scroll the selected planes 4 pixels right (positive) or left; one shift per row
+static ALWAYS_INLINE void scroll_across(display_plane_t *display, int8_t pixels, bool hires, uint8_t planes,
+                                        const chip8_quirks_t quirks)
+{
+    const uint8_t height = hires ? DISPLAY_HEIGHT : DISPLAY_HEIGHT / 2;
+    const display_row_t in_use = display_row_mask(hires);
+    for (uint8_t p = 0; p < DISPLAY_PLANES; p++)
+    {
+        if (!(planes & (1 << p))) continue;
+        for (uint8_t y = 0; y < height; y++)
+        {
+            const display_row_t row = row_get(display, p, y, quirks.schip);
+            row_put(display, p, y, row_and(pixels > 0 ? row_shr(row, pixels) : row_shl(row, -pixels), in_use),
+                    quirks.schip);
+        }
+    }
+}
+
+// bytes a taken skip moves PC past: 2, or 4 over XO-CHIP's two word F000 NNNN
+static ALWAYS_INLINE uint16_t skip_size(const chip8_mem_t *mem, uint16_t PC, const chip8_quirks_t quirks)
+{
+    if (!quirks.xochip) return 2;
+    return mem_read(mem, PC) == 0xF0 && mem_read(mem, PC + 1) == 0x00 ? 4 : 2;
+}
+
+// self-modifying code: count the instruction about to execute if its bytes changed since it last
+// ran at this address. Only addresses whose pages were written in between are compared, as a
+// decoded code cache would check before reusing an entry
+static ALWAYS_INLINE void profile_code(chip8_profile_t *profile, const chip8_t *chip8)
+{
+    const uint16_t addr = chip8->PC & (RAM_SIZE - 1);
+    const bool is_long = chip8->inst.opcode == 0xF000;
+    const uint64_t generation = mem_range_generation(&chip8->mem, chip8->PC, is_long ? 4 : 2);
+    if (profile->pc[addr] && profile->code_generation[addr] == generation) return;
+
+    const uint32_t code = (uint32_t)chip8->inst.opcode << 16 |
+                          (is_long ? mem_read(&chip8->mem, chip8->PC + 2) << 8 | mem_read(&chip8->mem, chip8->PC + 3) : 0);
+    if (profile->pc[addr] && profile->code[addr] != code)
+    {
+        profile->rewrites[addr]++;
+        profile->total_rewrites++;
+    }
+    profile->code[addr] = code;
+    profile->code_generation[addr] = generation;
+}
+
+// shadow call stack upkeep for one instruction about to execute: charge it to the current
+// subroutine, then follow 2NNN into a child path or 00EE back out to the parent
+static void profile_calls(chip8_profile_t *profile, const chip8_t *chip8)
+{
+    if (profile->num_nodes == 0)
+    {
+        profile->nodes[0].addr = chip8->PC;
+        profile->num_nodes = 1;
+    }
+
+    const uint32_t current = profile->depth ? profile->frames[profile->depth - 1].node : 0;
+    profile->nodes[current].self++;
+    if (profile->depth) profile->exclusive[profile->nodes[current].addr]++;
+
+    const uint16_t opcode = chip8->inst.opcode;
+    if ((opcode >> 12) == 0x2)
+    {
+        const uint16_t addr = opcode & 0x0FFF;
+        profile->calls[addr]++;
+        if (profile->untracked || profile->depth == PROFILE_MAX_DEPTH)
+        {
+            profile->untracked++;
+            return;
+        }
+
+        // find or add the child path
+        uint32_t child = profile->nodes[current].first_child;
+        while (child && profile->nodes[child].addr != addr) child = profile->nodes[child].next_sibling;
+        if (!child)
+        {
+            if (profile->num_nodes == PROFILE_MAX_NODES)
+            {
+                profile->untracked++;
+                return;
+            }
+            child = profile->num_nodes++;
+            profile->nodes[child] = (profile_node_t){
+                .addr = addr, .parent = current, .next_sibling = profile->nodes[current].first_child,
+            };
+            profile->nodes[current].first_child = child;
+        }
+
+        profile->frames[profile->depth++] = (profile_frame_t){ .node = child, .start = chip8->cycles + 1 };
+    }
+    else if (opcode == 0x00EE)
+    {
+        if (profile->untracked)
+        {
+            profile->untracked--;
+            return;
+        }
+        if (!profile->depth) return;
+
+        // recursive calls only count the outermost frame, so cycles aren't counted twice
+        const profile_frame_t *frame = &profile->frames[--profile->depth];
+        const uint16_t addr = profile->nodes[frame->node].addr;
+        bool recursive = false;
+        for (uint32_t d = 0; d < profile->depth; d++) recursive |= profile->nodes[profile->frames[d].node].addr == addr;
+        if (!recursive) profile->inclusive[addr] += chip8->cycles + 1 - frame->start;
+    }
+}
+
+// the interpreter body; specialized below into plain and profiling variants of every platform.
+// profile and quirks are compile time constants in each, so the checks on them fold away
+static ALWAYS_INLINE void emulate_instruction_impl(chip8_t *chip8, chip8_profile_t *profile, const chip8_quirks_t quirks)
+{
+    // get next opcode from RAM
+    chip8->inst.opcode = (mem_read(&chip8->mem, chip8->PC) << 8) | mem_read(&chip8->mem, chip8->PC+1);
+
+    // profile is a compile time NULL in the plain variant, so this folds away there
+    if (profile)
+    {
+        profile_code(profile, chip8);
+        profile->pc[chip8->PC & (RAM_SIZE - 1)]++;
+        profile->op_class[chip8->inst.opcode >> 12]++;
+        profile->total++;
+        profile_calls(profile, chip8);
+    }
+
+    // pre-increment program counter for next opcode
+    chip8->PC += 2;
+    chip8->cycles++;
+
+    // fill out most recent instruction format
+    chip8->inst.NNN = chip8->inst.opcode & 0x0FFF;
+    chip8->inst.NN = chip8->inst.opcode & 0x0FF;
+    chip8->inst.N = chip8->inst.opcode & 0x0F;
+    chip8->inst.X = (chip8->inst.opcode >> 8) & 0x0F;
+    chip8->inst.Y = (chip8->inst.opcode >> 4) & 0x0F;
+
+#ifdef DEBUG
+    // tracing: remember what the instruction started from so the entry can record deltas
+    const uint16_t trace_PC = chip8->PC - 2;
+    uint8_t trace_V[16];
+    if (trace.enabled) memcpy(trace_V, chip8->V, sizeof trace_V);
+#endif
+
+    // emulate opcode; one case per opcode_table entry
+    switch (opcode_id(chip8->inst.opcode))
+    {
+        case OP_CLS:
+            // 0x00E0: Clear the screen (the selected planes on XO-CHIP)
+            // set the display memory to clear the screen
+            clear_planes(chip8->display, active_planes(chip8->planes, quirks), quirks);
+            chip8->display_written = 0xFF;
+            break;
+
+        case OP_RET:
+            // 0x00EE: Return from subroutine
+            // Set program counter to last address on subroutine stack (pop it off the stack)
+            // such that next opcode code will be taken from that address,
+            chip8->fault |= (chip8->stack_ptr == 0) * FAULT_STACK_UNDERFLOW;
+            chip8->stack_ptr = (chip8->stack_ptr - 1) & (STACK_DEPTH - 1);
+            chip8->PC = chip8->stack[chip8->stack_ptr];
+            break;
+
+        // SCHIP display instructions; no-ops (0NNN machine calls) on plain CHIP-8
+        case OP_SCD:
+            // 0x00CN: Scroll the display down N pixels
+            if (!quirks.schip) break;
+            scroll_vertical(chip8->display, chip8->inst.N, chip8->hires, active_planes(chip8->planes, quirks), quirks);
+            chip8->display_written = 0xFF;
+            break;
+
+        case OP_SCU:
+            // 0x00DN: Scroll the display up N pixels
+            if (!quirks.xochip) break;
+            scroll_vertical(chip8->display, -chip8->inst.N, chip8->hires, chip8->planes, quirks);
+            chip8->display_written = 0xFF;
+            break;
+
+        case OP_SCR:
+            // 0x00FB: Scroll the display right 4 pixels
+            if (!quirks.schip) break;
+            scroll_across(chip8->display, 4, chip8->hires, active_planes(chip8->planes, quirks), quirks);
+            chip8->display_written = 0xFF;
+            break;
+
+        case OP_SCL:
+            // 0x00FC: Scroll the display left 4 pixels
+            if (!quirks.schip) break;
+            scroll_across(chip8->display, -4, chip8->hires, active_planes(chip8->planes, quirks), quirks);
+            chip8->display_written = 0xFF;
+            break;
+
+        case OP_EXIT:
+            // 0x00FD: Exit; the machine stays on this instruction, and the emulator quits
+            if (!quirks.schip) break;
+            chip8->PC -= 2;
+            chip8->state = QUIT;
+            break;
+
+        case OP_LOW:
+        case OP_HIGH:
+            // 0x00FE/0x00FF: Switch to lo-res/hi-res; the screen is cleared, as its pixels change size
+            if (!quirks.schip) break;
+            chip8->hires = chip8->inst.opcode == 0x00FF;
+            memset(chip8->display, 0, display_bytes(chip8->display_planes, chip8->display_full));
+            chip8->display_written = 0xFF;
+            break;
+
+        case OP_JP:
+            // 0x1NNN: Jump to address NNN
+            chip8->PC = chip8->inst.NNN;
+            break;
+
+        case OP_CALL:
+            // 0x2NNN: Call subroutine at NNN
+            // Store curent address for return to subroutine stack
+            // and set program counter to subroutine address
+            // such that the next opcode is taken from there.
+            chip8->stack[chip8->stack_ptr] = chip8->PC;
+            chip8->stack_ptr = (chip8->stack_ptr + 1) & (STACK_DEPTH - 1);
+            chip8->fault |= (chip8->stack_ptr == 0) * FAULT_STACK_OVERFLOW;
+            chip8->PC = chip8->inst.NNN;
+            break;
+
+        case OP_SE:
+            // 0x3XNN: Check if VX == NN, if so, skip the next instruction
+            if(chip8->V[chip8->inst.X] == chip8->inst.NN)
+            {
+                chip8->PC += skip_size(&chip8->mem, chip8->PC, quirks); // skip next opcode
+            }
+            break;
+
+        case OP_SNE:
+            // 0x4XNN: Check if VX != NN, if so, skip the next instruction
+            if(chip8->V[chip8->inst.X] != chip8->inst.NN)
+            {
+                chip8->PC += skip_size(&chip8->mem, chip8->PC, quirks); // skip next opcode
+            }
+            break;
+
+        case OP_SE_V:
+            // 0x5XY0: Check if VX == VY, if so, skip next instruction
+            if(chip8->V[chip8->inst.X] == chip8->V[chip8->inst.Y])
+            {
+                chip8->PC += skip_size(&chip8->mem, chip8->PC, quirks); // skip next opcode
+            }
+            break;
+
+        // XO-CHIP range save and load: VX to VY, in either direction, without touching I
+        case OP_ST_XY:
+            // 0x5XY2: Store VX-VY inclusive to memory from I
+            if (!quirks.xochip) break;
+            {
+                const int8_t step = chip8->inst.X <= chip8->inst.Y ? 1 : -1;
+                for (uint8_t i = 0, r = chip8->inst.X; ; i++, r += step)
+                {
+                    mem_write(&chip8->mem, chip8->I + i, chip8->V[r]);
+                    if (r == chip8->inst.Y) break;
+                }
+            }
+            break;
+
+        case OP_LD_XY:
+            // 0x5XY3: Load VX-VY inclusive from memory at I
+            if (!quirks.xochip) break;
+            {
+                const int8_t step = chip8->inst.X <= chip8->inst.Y ? 1 : -1;
+                for (uint8_t i = 0, r = chip8->inst.X; ; i++, r += step)
+                {
+                    chip8->V[r] = mem_read(&chip8->mem, chip8->I + i);
+                    if (r == chip8->inst.Y) break;
+                }
+            }
+            break;
+
+        case OP_LD:
+            // 0x6XNN: Set register VX to NN
+            // V offset by X
+            chip8->V[chip8->inst.X] = chip8->inst.NN;
+            break;
+
+        case OP_ADD:
+            // 0x7XNN: Set register VX += NN
+            chip8->V[chip8->inst.X] += chip8->inst.NN;
+            break;
+
+        case OP_LD_V:
+            // 0x8XY0: Set register VX = VY
+            chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y];
+            break;
+
+        case OP_OR:
+            // 0x8XY1: Set register VX |= VY; COSMAC VIP clears VF
+            chip8->V[chip8->inst.X] |= chip8->V[chip8->inst.Y];
+            if (quirks.vf_reset) chip8->V[0xF] = 0;
+            break;
+
+        case OP_AND:
+            // 0x8XY2: Set register VX &= VY; COSMAC VIP clears VF
+            chip8->V[chip8->inst.X] &= chip8->V[chip8->inst.Y];
+            if (quirks.vf_reset) chip8->V[0xF] = 0;
+            break;
+
+        case OP_XOR:
+            // 0x8XY3: Set register VX ^= VY; COSMAC VIP clears VF
+            chip8->V[chip8->inst.X] ^= chip8->V[chip8->inst.Y];
+            if (quirks.vf_reset) chip8->V[0xF] = 0;
+            break;
+
+        // 8XY4-8XYE work the flag out from the operands first. CHIP8 writes it before the result,
+        // which then reads the registers afresh (X or Y == F see the flag); with flag_after_result
+        // it is written last, so with X == F the flag wins
+
+        case OP_ADD_V:
+            // 0x8XY4: Set register VX += VY, set VF to 1 if carry (and to 0 if not, unless CHIP8)
+            {
+                const uint8_t carry = (uint16_t)(chip8->V[chip8->inst.X] + chip8->V[chip8->inst.Y]) > 255;
+                if (!quirks.flag_after_result) set_flag(chip8, carry, !quirks.vf_clear_on_no_carry);
+                chip8->V[chip8->inst.X] += chip8->V[chip8->inst.Y];
+                if (quirks.flag_after_result) set_flag(chip8, carry, !quirks.vf_clear_on_no_carry);
+            }
+            break;
+
+        case OP_SUB:
+            // 0x8XY5: Set register VX -= VY, set VF to 1 if there is not a borrow (result is positive)
+            {
+                const uint8_t no_borrow = chip8->V[chip8->inst.Y] <= chip8->V[chip8->inst.X];
+                if (!quirks.flag_after_result) chip8->V[0xF] = no_borrow;
+                chip8->V[chip8->inst.X] -= chip8->V[chip8->inst.Y];
+                if (quirks.flag_after_result) chip8->V[0xF] = no_borrow;
+            }
+            break;
+
+        case OP_SHR:
+            // 0x8XY6: Set register VX = VY >> 1 (SCHIP: VX >>= 1), store shifted off bit in VF
+            {
+                const uint8_t src = quirks.shift_vy ? chip8->inst.Y : chip8->inst.X;
+                const uint8_t bit = chip8->V[src] & 1;
+                if (!quirks.flag_after_result) chip8->V[0xF] = bit;
+                chip8->V[chip8->inst.X] = chip8->V[src] >> 1;
+                if (quirks.flag_after_result) chip8->V[0xF] = bit;
+            }
+            break;
+
+        case OP_SUBN:
+            // 0x8XY7: Set register VX = VY - VX. set VF to 1 if there is not a borrow (result is positive)
+            {
+                const uint8_t no_borrow = chip8->V[chip8->inst.X] <= chip8->V[chip8->inst.Y];
+                if (!quirks.flag_after_result) chip8->V[0xF] = no_borrow;
+                chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y] - chip8->V[chip8->inst.X];
+                if (quirks.flag_after_result) chip8->V[0xF] = no_borrow;
+            }
+            break;
+
+        case OP_SHL:
+            // 0x8XYE: Set register VX = VY << 1 (SCHIP: VX <<= 1), store shifted off bit in VF
+            {
+                const uint8_t src = quirks.shift_vy ? chip8->inst.Y : chip8->inst.X;
+                const uint8_t bit = chip8->V[src] >> 7;
+                if (!quirks.flag_after_result) chip8->V[0xF] = bit;
+                chip8->V[chip8->inst.X] = chip8->V[src] << 1;
+                if (quirks.flag_after_result) chip8->V[0xF] = bit;
+            }
+            break;
+
+        case OP_SNE_V:
+            // 0x9XY0: Check if VX != VY; skip next instruction if so
+            if (chip8->V[chip8->inst.X] != chip8->V[chip8->inst.Y])
+            {
+                chip8->PC += skip_size(&chip8->mem, chip8->PC, quirks);
+            }
+            break;
+
+        case OP_LD_I:
+            // 0XANNN: Set index register I to NNN
+            chip8->I = chip8->inst.NNN;
+            break;
+
+        case OP_JP_V0:
+            // 0xBNNN: Jump to V0 + NNN; SCHIP reads it as BXNN, jump to VX + XNN
+            chip8->PC = chip8->V[quirks.jump_vx ? chip8->inst.X : 0] + chip8->inst.NNN;
+            break;
+
+        case OP_RND:
+            // 0xCXNN: Set register VX = rand() % 256 & NN (bitwise AND)
+            chip8->V[chip8->inst.X] = (chip8_rand(&chip8->rng) >> 24) & chip8->inst.NN;
+            break;
+
+        case OP_DRW16:
+        case OP_DRW:
+            // 0xDXYN: Draw N-height sprite at coordinate X,Y; 0xDXY0 draws 16x16 on SCHIP
+            // Read from location memory I
+            // Screen pixels are XOR'd with sprite bits,
+            // VF (Carry flag) is set if any screen pixels are set off; useful for collision detection
+
+            // bands first: VY may be VF
+            chip8->display_written |= display_bands(chip8->V[chip8->inst.Y], sprite_rows(chip8->inst.N, quirks),
+                                                    chip8->hires, quirks.wrap_sprites);
+            chip8->V[0xF] = draw_sprite(chip8->display, &chip8->mem, chip8->I, chip8->V[chip8->inst.X],
+                                        chip8->V[chip8->inst.Y], chip8->inst.N, chip8->hires,
+                                        active_planes(chip8->planes, quirks), quirks);
+            break;
+
+        case OP_SKP:
+            // 0xEX9E: Skip next instruction if key in VX is pressed; keys past 0xF wrap
+            chip8->fault |= (chip8->V[chip8->inst.X] > 0xF) * FAULT_BAD_KEY;
+            if (chip8->keypad[chip8->V[chip8->inst.X] & 0xF])
+            {
+                chip8->PC += skip_size(&chip8->mem, chip8->PC, quirks);
+            }
+            break;
+
+        case OP_SKNP:
+            // 0xEXA1: Skip next instruciton if key in VX is not pressed
+            chip8->fault |= (chip8->V[chip8->inst.X] > 0xF) * FAULT_BAD_KEY;
+            if (!chip8->keypad[chip8->V[chip8->inst.X] & 0xF])
+            {
+                chip8->PC += skip_size(&chip8->mem, chip8->PC, quirks);
+            }
+            break;
+
+        case OP_LD_K:
+            // 0xFX0A : VX = get_key(); Await until a keypress, and store in VX
+            bool any_key_pressed = false;
+            for (uint8_t i = 0; i < sizeof(chip8->keypad); i++)
+            {
+                if (chip8->keypad[i])
+                {
+                    chip8->V[chip8->inst.X] = i;                // i = key (offset into keypad array)
+                    any_key_pressed = true;
+                    break;
+                }
+            }
+
+            // If no key has been pressed, then keep grabbing the current opcode and run it.
+            if (!any_key_pressed) chip8->PC -= 2;
+            break;
+
+        case OP_ADD_I:
+            // 0xFX1E: I += VX; Add VX to register I.
+            chip8->I += chip8->V[chip8->inst.X];
+            break;
+
+        case OP_LONG:
+            // 0xF000 NNNN: Set I to the 16 bit address NNNN in the next word, and step over it (XO-CHIP)
+            if (!quirks.xochip) break;
+            chip8->I = (mem_read(&chip8->mem, chip8->PC) << 8) | mem_read(&chip8->mem, chip8->PC + 1);
+            chip8->PC += 2;
+            break;
+
+        case OP_PLANE:
+            // 0xFN01: Select the display planes (bit per plane) that draws, clears and scrolls act on (XO-CHIP)
+            if (!quirks.xochip) break;
+            chip8->planes = chip8->inst.X;
+            break;
+
+        case OP_LD_DT:
+            // 0xFX07: Set VX = delay timer
+            chip8->V[chip8->inst.X] = chip8->delay_timer;
+            break;
+
+        case OP_SET_DT:
+            // 0xFX15: Set delay timer = VX
+            chip8->delay_timer = chip8->V[chip8->inst.X];
+            break;
+
+        case OP_SET_ST:
+            // 0xFX18: Set sound timer = VX
+            chip8->sound_timer = chip8->V[chip8->inst.X];
+            break;
+
+        case OP_LD_F:
+            // 0xFX29: Set register I to sprite location in memory for character in VX (0x0 to 0xF)
+            chip8->I = chip8->V[chip8->inst.X] * 5;
+            break;
+
+        case OP_LD_HF:
+            // 0xFX30: Set register I to the 8x10 sprite for digit VX (SCHIP)
+            if (!quirks.schip) break;
+            chip8->I = BIG_FONT_ADDR + (chip8->V[chip8->inst.X] & 0xF) * 10;
+            break;
+
+        case OP_LD_B:
+            // 0xFX33: Store BCD representation of VX at memory offset from I
+            uint8_t bcd = chip8->V[chip8->inst.X];
+            mem_write(&chip8->mem, chip8->I+2, bcd % 10);
+            bcd /= 10;
+            mem_write(&chip8->mem, chip8->I+1, bcd % 10);
+            bcd /= 10;
+            mem_write(&chip8->mem, chip8->I, bcd);
+            break;
+
+        case OP_STORE:
+            // 0xFX55: Register dump V0-VX inclusive to memory offset from I;
+            // note: SCHIP does not increment I, CHIP8 does increment I
+            for (uint8_t i = 0; i <= chip8->inst.X; i++)
+            {
+                mem_write(&chip8->mem, chip8->I + i, chip8->V[i]);
+            }
+            if (quirks.load_store_inc) chip8->I += chip8->inst.X + 1;
+            break;
+
+        case OP_LOAD:
+            // 0xFX65: Register load V0-VX inclusive to memory offset from I.
+            // note: SCHIP does not increment I, CHIP8 does increment I
+            for (uint8_t i = 0; i <= chip8->inst.X; i++)
+            {
+               chip8->V[i] = mem_read(&chip8->mem, chip8->I + i);
+            }
+            if (quirks.load_store_inc) chip8->I += chip8->inst.X + 1;
+            break;
+
+        case OP_SAVE_R:
+            // 0xFX75: Store V0-VX inclusive in the RPL user flags (SCHIP)
+            if (!quirks.schip) break;
+            memcpy(chip8->rpl, chip8->V, chip8->inst.X + 1);
+            break;
+
+        case OP_LOAD_R:
+            // 0xFX85: Load V0-VX inclusive from the RPL user flags (SCHIP)
+            if (!quirks.schip) break;
+            memcpy(chip8->V, chip8->rpl, chip8->inst.X + 1);
+            break;
+
+        default:
+            // unimplemented or invalid opcode
+            break;
+    }
+
+#ifdef DEBUG
+    if (trace.enabled) trace_record(chip8, trace_PC, trace_V);
+#endif
+}
+
+// a single instruction, for one-off steps; loops pick a chip8_stepper or run emulate_instructions
+void emulate_instruction(chip8_t *chip8)
+{
+#define SPECIALIZE(quirks) emulate_instruction_impl(chip8, NULL, quirks)
+    DISPATCH_PLATFORM(chip8->platform)
+#undef SPECIALIZE
+}
+
+// as emulate_instruction, also counting executions per PC and opcode class
+void emulate_instruction_profiled(chip8_t *chip8, chip8_profile_t *profile)
+{
+#define SPECIALIZE(quirks) emulate_instruction_impl(chip8, profile, quirks)
+    DISPATCH_PLATFORM(chip8->platform)
+#undef SPECIALIZE
+}
+
+// count instructions in one specialized loop: the platform is picked once, not per instruction
+void emulate_instructions(chip8_t *chip8, uint32_t count)
+{
+#define SPECIALIZE(quirks) for (uint32_t i = 0; i < count; i++) emulate_instruction_impl(chip8, NULL, quirks)
+    DISPATCH_PLATFORM(chip8->platform)
+#undef SPECIALIZE
+}
+
+// as emulate_instructions, also counting executions per PC and opcode class
+void emulate_instructions_profiled(chip8_t *chip8, chip8_profile_t *profile, uint32_t count)
+{
+#define SPECIALIZE(quirks) for (uint32_t i = 0; i < count; i++) emulate_instruction_impl(chip8, profile, quirks)
+    DISPATCH_PLATFORM(chip8->platform)
+#undef SPECIALIZE
+}
+
+#define PLATFORM_STEPS(id, ...) \
+    static void step_##id(chip8_t *chip8, chip8_profile_t *profile) \
+    { \
+        (void)profile; \
+        emulate_instruction_impl(chip8, NULL, platform_quirks[PLATFORM_##id]); \
+    } \
+    static void step_profiled_##id(chip8_t *chip8, chip8_profile_t *profile) \
+    { \
+        emulate_instruction_impl(chip8, profile, platform_quirks[PLATFORM_##id]); \
+    }
+CHIP8_PLATFORMS(PLATFORM_STEPS)
+#undef PLATFORM_STEPS
+
+// the single step specialized for a platform, for loops that check something between
+// instructions (breakpoints, replayed input, coverage): picked once before the loop, each
+// step is one indirect call rather than a switch on the platform
+chip8_step_fn chip8_stepper(chip8_platform_t platform, bool profiled)
+{
+    static const chip8_step_fn steps[NUM_PLATFORMS][2] = {
+#define PLATFORM_STEP(id, ...) [PLATFORM_##id] = { step_##id, step_profiled_##id },
+        CHIP8_PLATFORMS(PLATFORM_STEP)
+#undef PLATFORM_STEP
+    };
+    return steps[platform][profiled];
+}
+
+void update_timers(chip8_t *chip8)
+{
+    if (chip8->delay_timer > 0) chip8->delay_timer--;
+
+    if (chip8->sound_timer > 0)
+    {
+        chip8->sound_timer--;
+
+        // TODO: Play sound
+    }
+    else
+    {
+        // TODO: Stop playing sound
+    }
+}
+
+// chip8_fault_t bits as text, e.g. "stack overflow, bad key"
+void describe_faults(uint8_t fault, char *buf, size_t size)
+{
+    static const char *names[] = { "stack overflow", "stack underflow", "bad key" };
+
+    size_t len = 0;
+    buf[0] = '\0';
+    for (uint8_t f = 0; f < sizeof names / sizeof names[0]; f++)
+    {
+        if (!(fault & (1 << f)) || len >= size) continue;
+        len += snprintf(buf + len, size - len, "%s%s", len ? ", " : "", names[f]);
+    }
+}
+
+// emulate one 60hz frame: a frame's worth of instructions, then the timers
+void run_frame(chip8_t *chip8)
+{
+    emulate_instructions(chip8, INSTRUCTS_PER_SECOND / 60);
+    update_timers(chip8);
+}
+
+// - - - - - - - - -
+// CHECKPOINTS
+// - - - - - - - - -
+
+// save the machine and its private pages, and start tracking dirty pages against this checkpoint.
+// A checkpoint's ram buffer is kept and reused by later checkpoints into it; free_checkpoint releases it
+void checkpoint_chip8(chip8_t *chip8, chip8_checkpoint_t *cp)
+{
+    cp->owned = chip8->mem.owned;
+
+    // room for every page up to the highest private one; a 4K machine never needs more than 4K
+    uint32_t size = 0;
+    for (uint32_t p = 0; p < mem_pages(&chip8->mem); p++)
+    {
+        if (page_test(&cp->owned, p)) size = (p + 1) * RAM_PAGE_SIZE;
+    }
+    if (size > cp->ram_size)
+    {
+        uint8_t *ram = realloc(cp->ram, size);
+        if (!ram)
+        {
+            SDL_Log("Out of memory taking a checkpoint\n");
+            exit(EXIT_FAILURE);
+        }
+        cp->ram = ram;
+        cp->ram_size = size;
+    }
+
+    for (uint32_t p = 0; p < mem_pages(&chip8->mem); p++)
+    {
+        if (page_test(&cp->owned, p)) memcpy(&cp->ram[p * RAM_PAGE_SIZE], chip8->mem.page[p], RAM_PAGE_SIZE);
+    }
+
+    page_fill(&chip8->mem.dirty, false);
+    chip8->checkpoint_serial++;
+
+    display_resize(&cp->display, &cp->display_planes, &cp->display_full, chip8->display_planes, chip8->display_full);
+    memcpy(cp->display, chip8->display, display_bytes(chip8->display_planes, chip8->display_full));
+
+    cp->machine = *chip8;
+    cp->machine.display = NULL;
+    cp->owner = chip8;
+    cp->serial = chip8->checkpoint_serial;
+}
+
+void free_checkpoint(chip8_checkpoint_t *cp)
+{
+    free(cp->ram);
+    cp->ram = NULL;
+    cp->ram_size = 0;
+    free(cp->display);
+    cp->display = NULL;
+}
+
+// put page p back to its checkpoint contents
+static void restore_page(chip8_mem_t *mem, const chip8_checkpoint_t *cp, uint32_t p)
+{
+    if (page_test(&cp->owned, p))
+    {
+        if (!page_test(&mem->owned, p)) mem_own_page(mem, p);
+        memcpy(mem->page[p], &cp->ram[p * RAM_PAGE_SIZE], RAM_PAGE_SIZE);
+        mem->generation[p]++;
+        page_add(&mem->written, p);
+    }
+    else if (page_test(&mem->owned, p))
+    {
+        // page was still shared at checkpoint time: drop the copy
+        free(mem->page[p]);
+        mem->page[p] = (uint8_t *)&mem->image->ram[p * RAM_PAGE_SIZE];
+        page_remove(&mem->owned, p);
+        mem->generation[p]++;
+        page_add(&mem->written, p);
+    }
+}
+
+// roll a machine back to a checkpoint. Restoring into the machine that took the checkpoint,
+// with no checkpoint taken since, only copies the pages written in between; any other
+// machine running the same image gets every page restored.
+void restore_chip8(chip8_t *chip8, const chip8_checkpoint_t *cp)
+{
+    const bool incremental = cp->owner == chip8 && cp->serial == chip8->checkpoint_serial;
+
+    for (uint32_t p = 0; p < mem_pages(&chip8->mem); p++)
+    {
+        if (!incremental || page_test(&chip8->mem.dirty, p)) restore_page(&chip8->mem, cp, p);
+    }
+
+    // registers and the rest come back wholesale; keep this machine's memory, display and identity
+    const chip8_mem_t mem = chip8->mem;
+    display_plane_t *display = chip8->display;
+    uint8_t display_planes = chip8->display_planes;
+    bool display_full = chip8->display_full;
+    chip8_image_t *own_image = chip8->own_image;
+    const uint32_t serial = chip8->checkpoint_serial;
+
+    *chip8 = cp->machine;
+    chip8->mem = mem;
+    display_resize(&display, &display_planes, &display_full, cp->display_planes, cp->display_full);
+    memcpy(display, cp->display, display_bytes(cp->display_planes, cp->display_full));
+    chip8->display = display;
+    chip8->display_planes = display_planes;
+    chip8->display_full = display_full;
+    page_fill(&chip8->mem.dirty, false);
+    chip8->own_image = own_image;
+    chip8->checkpoint_serial = incremental ? serial : serial + 1;
+    chip8->display_written = 0xFF;
+}
+
+// - - - - - - - - -
+// INPUT MOVIES
+// - - - - - - - - -
+
+// read a keypad movie into keys[0..frames): one "<frame> <hex keymask>" per line,
+// each mask held from its frame until the next line's
+bool load_movie(const char *path, uint16_t *keys, uint32_t frames)
+{
+    FILE *in = fopen(path, "r");
+    if (!in)
+    {
+        SDL_Log("Could not open movie %s\n", path);
+        return false;
+    }
+
+    uint32_t frame;
+    unsigned mask;
+    while (fscanf(in, "%u %x", &frame, &mask) == 2)
+    {
+        for (uint32_t f = frame; f < frames; f++) keys[f] = (uint16_t)mask;
+    }
+    fclose(in);
+    return true;
+}
+
+// set the keypad from a movie's mask for one frame
+void apply_keys(chip8_t *chip8, uint16_t mask)
+{
+    for (uint8_t k = 0; k < 16; k++) chip8->keypad[k] = (mask >> k) & 1;
+}
+
+// - - - - - - - - -
+// DEBUGGER
+// - - - - - - - - -
+
+static inline bool bitmap_test(const uint64_t *bits, uint16_t addr)
+{
+    addr &= RAM_SIZE - 1;
+    return (bits[addr >> 6] >> (addr & 63)) & 1;
+}
+
+// flip one address in a bitmap, keeping the armed count in step
+static void debugger_toggle(debugger_t *dbg, uint64_t *bits, uint16_t addr)
+{
+    addr &= RAM_SIZE - 1;
+    bits[addr >> 6] ^= 1ull << (addr & 63);
+    if (bitmap_test(bits, addr)) dbg->armed++;
+    else dbg->armed--;
+}
+
+// FX33, FX55 and XO-CHIP's 5XY2 are the only instructions that write ram: bytes the next one writes from I
+static uint8_t ram_write_len(const chip8_t *chip8)
+{
+    const uint16_t opcode = (mem_read(&chip8->mem, chip8->PC) << 8) | mem_read(&chip8->mem, chip8->PC + 1);
+    const uint8_t X = (opcode >> 8) & 0x0F, Y = (opcode >> 4) & 0x0F;
+    if ((opcode & 0xF0FF) == 0xF033) return 3;
+    if ((opcode & 0xF0FF) == 0xF055) return X + 1;
+    if ((opcode & 0xF00F) == 0x5002 && platform_quirks[chip8->platform].xochip) return (X > Y ? X - Y : Y - X) + 1;
+    return 0;
+}
+
+// first watched address among len bytes from I, or -1
+static int32_t watched_write(const debugger_t *dbg, uint16_t I, uint8_t len)
+{
+    for (uint8_t i = 0; i < len; i++)
+    {
+        if (bitmap_test(dbg->watchpoints, I + i)) return (I + i) & (RAM_SIZE - 1);
+    }
+    return -1;
+}
+
+// emulate up to count instructions, stopping at breakpoints and watchpoints, and counting them
+// in the profile when there is one. Only called while something is armed; returns false (with
+// the machine paused) when one was hit
+bool debugger_emulate(debugger_t *dbg, chip8_t *chip8, chip8_profile_t *profile, uint32_t count)
+{
+    const chip8_step_fn step = chip8_stepper(chip8->platform, profile != NULL);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (bitmap_test(dbg->breakpoints, chip8->PC) && !dbg->skip_break)
+        {
+            printf("breakpoint at 0x%03X\n", chip8->PC);
+            chip8->state = PAUSED;
+            dbg->skip_break = true;       // continuing runs this instruction
+            return false;
+        }
+        dbg->skip_break = false;
+
+        const uint16_t PC = chip8->PC;
+        const uint16_t I = chip8->I;
+        const uint8_t len = ram_write_len(chip8);
+
+        step(chip8, profile);
+
+        const int32_t addr = watched_write(dbg, I, len);
+        if (addr >= 0)
+        {
+            printf("watchpoint 0x%03X written by 0x%03X, now 0x%02X\n", addr, PC, mem_read(&chip8->mem, addr));
+            chip8->state = PAUSED;
+            return false;
+        }
+    }
+    return true;
+}
+
+// - - - - - - - - - - -
+// REVERSE EXECUTION
+// - - - - - - - - - - -
+
+static uint16_t keypad_mask(const chip8_t *chip8)
+{
+    uint16_t mask = 0;
+    for (uint8_t k = 0; k < 16; k++) mask |= (uint16_t)chip8->keypad[k] << k;
+    return mask;
+}
+
+// keep a checkpoint every 'spacing' frames, as many as fit in budget bytes for a machine
+// with ram_size bytes of address space (if it ever wrote all of it)
+bool history_init(history_t *h, size_t budget, uint32_t spacing, uint32_t ram_size)
+{
+    memset(h, 0, sizeof *h);
+    h->capacity = budget / (sizeof(chip8_checkpoint_t) + DISPLAY_PLANES * sizeof(display_plane_t) + ram_size);
+    if (h->capacity < 1) h->capacity = 1;
+    h->spacing = spacing ? spacing : 1;
+    h->frames_since = h->spacing;         // first frame takes a checkpoint
+
+    h->checkpoints = calloc(h->capacity, sizeof *h->checkpoints);
+    h->checkpoint_event = malloc(h->capacity * sizeof *h->checkpoint_event);
+    if (!h->checkpoints || !h->checkpoint_event)
+    {
+        SDL_Log("Could not allocate %u checkpoints for reverse execution\n", h->capacity);
+        free(h->checkpoints);
+        free(h->checkpoint_event);
+        return false;
+    }
+    return true;
+}
+
+void history_free(history_t *h)
+{
+    for (uint32_t c = 0; c < h->capacity && h->checkpoints; c++) free_checkpoint(&h->checkpoints[c]);
+    free(h->checkpoints);
+    free(h->checkpoint_event);
+    free(h->events);
+}
+
+static void history_log(history_t *h, uint64_t cycle, uint16_t keys, bool timer_tick)
+{
+    if (h->num_events == h->events_capacity)
+    {
+        const size_t capacity = h->events_capacity ? h->events_capacity * 2 : 1024;
+        history_event_t *events = realloc(h->events, capacity * sizeof *events);
+        if (!events)
+        {
+            SDL_Log("Out of memory recording input\n");
+            exit(EXIT_FAILURE);
+        }
+        h->events = events;
+        h->events_capacity = capacity;
+    }
+    h->events[h->num_events++] = (history_event_t){ .cycle = cycle, .keys = keys, .timer_tick = timer_tick };
+}
+
+static uint32_t history_ring(const history_t *h, uint32_t slot)
+{
+    return (h->first + slot) % h->capacity;
+}
+
+static uint64_t history_cycle(const history_t *h, uint32_t slot)
+{
+    return h->checkpoints[history_ring(h, slot)].machine.cycles;
+}
+
+// called at the start of every emulated frame, after input was read
+void history_frame(history_t *h, chip8_t *chip8)
+{
+    if (++h->frames_since >= h->spacing)
+    {
+        h->frames_since = 0;
+
+        // full ring: the oldest checkpoint and the events only it needed go
+        if (h->count == h->capacity)
+        {
+            h->first = history_ring(h, 1);
+            h->count--;
+
+            const uint64_t keep = h->checkpoint_event[h->first];
+            const size_t drop = keep - h->events_base;
+            memmove(h->events, h->events + drop, (h->num_events - drop) * sizeof *h->events);
+            h->num_events -= drop;
+            h->events_base = keep;
+        }
+
+        const uint32_t ring = history_ring(h, h->count++);
+        checkpoint_chip8(chip8, &h->checkpoints[ring]);
+        h->checkpoint_event[ring] = h->events_base + h->num_events;
+        h->keys = keypad_mask(chip8);     // part of the checkpoint
+    }
+
+    const uint16_t keys = keypad_mask(chip8);
+    if (keys != h->keys) history_log(h, chip8->cycles, keys, false);
+    h->keys = keys;
+}
+
+// called after every update_timers
+void history_timer(history_t *h, const chip8_t *chip8)
+{
+    history_log(h, chip8->cycles, 0, true);
+}
+
+// re-execute from checkpoint 'slot' up to to_cycle, replaying input and timer ticks where they
+// happened. With a debugger, returns the last cycle before limit at which a breakpoint was
+// reached (state before it runs) or a watched address written (state after); else UINT64_MAX
+static uint64_t history_replay(const history_t *h, chip8_t *chip8, uint32_t slot, uint64_t to_cycle,
+                               const debugger_t *dbg, uint64_t limit)
+{
+    const uint32_t ring = history_ring(h, slot);
+    restore_chip8(chip8, &h->checkpoints[ring]);
+    size_t e = h->checkpoint_event[ring] - h->events_base;
+    uint64_t hit = UINT64_MAX;
+    const chip8_step_fn step = chip8_stepper(chip8->platform, false);
+
+    for (;;)
+    {
+        for (; e < h->num_events && h->events[e].cycle <= chip8->cycles; e++)
+        {
+            if (h->events[e].timer_tick) update_timers(chip8);
+            else apply_keys(chip8, h->events[e].keys);
+        }
+        if (chip8->cycles >= to_cycle) break;
+
+        if (!dbg)
+        {
+            // nothing to check in between: run straight to the next event
+            const uint64_t next = e < h->num_events && h->events[e].cycle < to_cycle ? h->events[e].cycle : to_cycle;
+            emulate_instructions(chip8, (uint32_t)(next - chip8->cycles));
+            continue;
+        }
+
+        if (bitmap_test(dbg->breakpoints, chip8->PC)) hit = chip8->cycles;
+        const uint16_t I = chip8->I;
+        const uint8_t len = ram_write_len(chip8);
+        step(chip8, NULL);
+        if (chip8->cycles < limit && watched_write(dbg, I, len) >= 0) hit = chip8->cycles;
+    }
+    return hit;
+}
+
+// newest checkpoint at or before cycle, or 0 (the oldest) if none is
+static uint32_t history_find(const history_t *h, uint64_t cycle)
+{
+    uint32_t slot = h->count - 1;
+    while (slot > 0 && history_cycle(h, slot) > cycle) slot--;
+    return slot;
+}
+
+// the run continues forward from here: forget the recorded future
+static void history_truncate(history_t *h, const chip8_t *chip8)
+{
+    while (h->count > 1 && history_cycle(h, h->count - 1) > chip8->cycles) h->count--;
+    while (h->num_events && h->events[h->num_events - 1].cycle > chip8->cycles) h->num_events--;
+    h->keys = keypad_mask(chip8);
+    h->frames_since = 0;
+}
+
+// go back n instructions (as far as the oldest checkpoint allows)
+bool history_reverse_step(history_t *h, chip8_t *chip8, uint64_t n)
+{
+    if (h->count == 0) return false;
+
+    const uint64_t oldest = history_cycle(h, 0);
+    const uint64_t target = chip8->cycles - oldest > n ? chip8->cycles - n : oldest;
+    history_replay(h, chip8, history_find(h, target), target, NULL, 0);
+    history_truncate(h, chip8);
+    chip8->state = PAUSED;
+    return true;
+}
+
+// go back to the previous breakpoint reached or watched address written; scans one checkpoint
+// interval at a time, newest first, and stops at the oldest checkpoint if there was none
+bool history_reverse_continue(history_t *h, debugger_t *dbg, chip8_t *chip8)
+{
+    if (h->count == 0) return false;
+
+    const uint64_t now = chip8->cycles;
+    uint64_t segment_end = now;
+    uint64_t hit = UINT64_MAX;
+    uint32_t slot = history_find(h, now);
+
+    for (;; slot--)
+    {
+        hit = history_replay(h, chip8, slot, segment_end, dbg, now);
+        if (hit != UINT64_MAX || slot == 0) break;
+        segment_end = history_cycle(h, slot);
+    }
+
+    const uint64_t target = hit != UINT64_MAX ? hit : history_cycle(h, 0);
+    history_replay(h, chip8, slot, target, NULL, 0);
+    history_truncate(h, chip8);
+    chip8->state = PAUSED;
+    dbg->skip_break = bitmap_test(dbg->breakpoints, chip8->PC);
+
+    if (hit == UINT64_MAX) printf("reached the oldest checkpoint, cycle %llu\n", (unsigned long long)target);
+    return true;
+}
+
+// - - - - - - - - - - -
+// DEBUGGER CONSOLE
+// - - - - - - - - - - -
+
+static void debugger_registers(const chip8_t *chip8)
+{
+    char desc[128];
+    const uint16_t opcode = (mem_read(&chip8->mem, chip8->PC) << 8) | mem_read(&chip8->mem, chip8->PC + 1);
+    disassemble_instruction(opcode, desc, sizeof desc);
+
+    printf("PC 0x%03X  0x%04X  %s\n", chip8->PC, opcode, desc);
+    printf("I  0x%03X  DT %u  ST %u  cycle %llu\n", chip8->I, chip8->delay_timer, chip8->sound_timer,
+           (unsigned long long)chip8->cycles);
+    for (uint8_t i = 0; i < 16; i++) printf("V%X %02X%s", i, chip8->V[i], i % 8 == 7 ? "\n" : "  ");
+    printf("stack:");
+    for (uint8_t i = 0; i < chip8->stack_ptr; i++) printf(" 0x%03X", chip8->stack[i]);
+    printf("\n");
+    if (chip8->fault)
+    {
+        char faults[64];
+        describe_faults(chip8->fault, faults, sizeof faults);
+        printf("faults: %s\n", faults);
+    }
+}
+
+static void debugger_memory(const chip8_t *chip8, uint16_t addr, uint16_t len)
+{
+    for (uint16_t row = 0; row < len; row += 16)
+    {
+        printf("0x%03X:", (addr + row) & (RAM_SIZE - 1));
+        for (uint16_t i = row; i < row + 16 && i < len; i++) printf(" %02X", mem_read(&chip8->mem, addr + i));
+        printf("\n");
+    }
+}
+
+static void debugger_disassemble(const debugger_t *dbg, const chip8_t *chip8, uint16_t addr, uint16_t count)
+{
+    for (uint16_t i = 0; i < count; i++, addr += 2)
+    {
+        char asm_text[32], desc[128];
+        const uint16_t opcode = (mem_read(&chip8->mem, addr) << 8) | mem_read(&chip8->mem, addr + 1);
+        disassemble_mnemonic(opcode, asm_text, sizeof asm_text);
+        disassemble_instruction(opcode, desc, sizeof desc);
+        printf("%c%c 0x%03X  0x%04X  %-20s %s\n", addr == chip8->PC ? '>' : ' ',
+               bitmap_test(dbg->breakpoints, addr) ? '*' : ' ', addr & (RAM_SIZE - 1), opcode, asm_text, desc);
+    }
+}
+
+static void debugger_list(const debugger_t *dbg)
+{
+    printf("breakpoints:");
+    for (uint32_t a = 0; a < RAM_SIZE; a++)
+    {
+        if (bitmap_test(dbg->breakpoints, a)) printf(" 0x%03X", a);
+    }
+    printf("\nwatchpoints:");
+    for (uint32_t a = 0; a < RAM_SIZE; a++)
+    {
+        if (bitmap_test(dbg->watchpoints, a)) printf(" 0x%03X", a);
+    }
+    printf("\n");
+}
+
+// read and run one console command while the machine is paused
+void debugger_command(debugger_t *dbg, chip8_t *chip8)
+{
+    printf("(chip8) ");
+    fflush(stdout);
+
+    char line[128];
+    if (!fgets(line, sizeof line, stdin))
+    {
+        // console closed: detach, drop every break/watchpoint and carry on running
+        memset(dbg, 0, sizeof *dbg);
+        chip8->state = RUNNING;
+        return;
+    }
+
+    char cmd = 0;
+    unsigned a = 0, b = 0;
+    const int args = sscanf(line, " %c %x %x", &cmd, &a, &b);
+
+    switch (cmd)
+    {
+        case 's':
+            // step N instructions (default 1), ignoring breakpoints on the way
+            emulate_instructions(chip8, args >= 2 ? a : 1);
+            dbg->skip_break = false;
+            debugger_registers(chip8);
+            break;
+
+        case 'c':
+            chip8->state = RUNNING;
+            break;
+
+        case 'S':
+            // step back N instructions (default 1)
+            if (!dbg->history || !history_reverse_step(dbg->history, chip8, args >= 2 ? a : 1))
+            {
+                printf("nothing recorded to step back through\n");
+                break;
+            }
+            debugger_registers(chip8);
+            break;
+
+        case 'C':
+            // run backwards to the previous breakpoint or watched write
+            if (!dbg->history || !history_reverse_continue(dbg->history, dbg, chip8))
+            {
+                printf("nothing recorded to run back through\n");
+                break;
+            }
+            debugger_registers(chip8);
+            break;
+
+        case 'r':
+            debugger_registers(chip8);
+            break;
+
+        case 'm':
+            debugger_memory(chip8, args >= 2 ? a : chip8->I, args >= 3 ? b : 64);
+            break;
+
+        case 'd':
+            debugger_disassemble(dbg, chip8, args >= 2 ? a : chip8->PC, args >= 3 ? b : 8);
+            break;
+
+        case 'b':
+            if (args >= 2) debugger_toggle(dbg, dbg->breakpoints, a);
+            debugger_list(dbg);
+            break;
+
+        case 'w':
+            for (unsigned i = 0; args >= 2 && i < (args >= 3 ? b : 1); i++) debugger_toggle(dbg, dbg->watchpoints, a + i);
+            debugger_list(dbg);
+            break;
+
+        case 'q':
+            chip8->state = QUIT;
+            break;
+
+        default:
+            printf("s [N] step | c continue | S [N] step back | C continue back | r registers | m [ADDR] [LEN] memory | d [ADDR] [N] disassemble\n"
+                   "b ADDR toggle breakpoint | w ADDR [LEN] toggle watchpoint | q quit   (numbers in hex)\n");
+            break;
+    }
+}
+
+// - - - - - - - - -
+// PROFILER
+// - - - - - - - - -
+
+static const char *op_class_names[16] = {
+    "0NNN clear/return", "1NNN jump", "2NNN call", "3XNN skip VX == NN",
+    "4XNN skip VX != NN", "5XY0 skip VX == VY", "6XNN set VX", "7XNN add VX",
+    "8XYN alu", "9XY0 skip VX != VY", "ANNN set I", "BNNN jump V0",
+    "CXNN random", "DXYN draw", "EXNN key skip", "FXNN timers/memory/keys",
+};
+
+static uint16_t profile_opcode(const chip8_t *chip8, uint16_t addr)
+{
+    return (mem_read(&chip8->mem, addr) << 8) | mem_read(&chip8->mem, addr + 1);
+}
+
+static const chip8_profile_t *sort_profile;   // qsort has no context argument in C17
+static int by_count(const void *a, const void *b)
+{
+    const uint64_t ca = sort_profile->pc[*(const uint16_t *)a];
+    const uint64_t cb = sort_profile->pc[*(const uint16_t *)b];
+    return (cb > ca) - (cb < ca);
+}
+
+// executed addresses, hottest first; returns how many
+static uint32_t profile_sorted(const chip8_profile_t *profile, uint16_t *addrs)
+{
+    uint32_t n = 0;
+    for (uint32_t a = 0; a < RAM_SIZE; a++)
+    {
+        if (profile->pc[a]) addrs[n++] = a;
+    }
+    sort_profile = profile;
+    qsort(addrs, n, sizeof *addrs, by_count);
+    return n;
+}
+
+// print opcode class counts, the top hottest addresses, and loops: a backward 1NNN
+// jump closes a loop over [NNN, jump], run once per time the jump executed
+void profile_report(const chip8_profile_t *profile, const chip8_t *chip8, FILE *out, uint32_t top)
+{
+    const double total = profile->total ? (double)profile->total : 1.0;
+    fprintf(out, "==== PROFILE: %llu instructions ====\n", (unsigned long long)profile->total);
+
+    fprintf(out, "-- opcode classes --\n");
+    for (uint8_t c = 0; c < 16; c++)
+    {
+        if (!profile->op_class[c]) continue;
+        fprintf(out, "%-26s %12llu %6.2f%%\n", op_class_names[c],
+                (unsigned long long)profile->op_class[c], 100.0 * profile->op_class[c] / total);
+    }
+
+    static uint16_t addrs[RAM_SIZE];
+    const uint32_t n = profile_sorted(profile, addrs);
+
+    fprintf(out, "-- hot addresses --\n");
+    for (uint32_t i = 0; i < n && i < top; i++)
+    {
+        const uint16_t opcode = profile_opcode(chip8, addrs[i]);
+        char desc[128];
+        disassemble_instruction(opcode, desc, sizeof desc);
+        fprintf(out, "0x%04X  0x%04X %12llu %6.2f%%  %s\n", addrs[i], opcode,
+                (unsigned long long)profile->pc[addrs[i]], 100.0 * profile->pc[addrs[i]] / total, desc);
+    }
+
+    // calls still open count up to now
+    static uint64_t inclusive[RAM_SIZE];
+    memcpy(inclusive, profile->inclusive, sizeof inclusive);
+    for (uint32_t d = 0; d < profile->depth; d++)
+    {
+        const uint16_t addr = profile->nodes[profile->frames[d].node].addr;
+        bool outer = true;
+        for (uint32_t o = 0; o < d; o++) outer &= profile->nodes[profile->frames[o].node].addr != addr;
+        if (outer) inclusive[addr] += chip8->cycles - profile->frames[d].start;
+    }
+
+    fprintf(out, "-- subroutines (inclusive / exclusive instructions) --\n");
+    for (uint32_t a = 0; a < RAM_SIZE; a++)
+    {
+        if (!profile->calls[a]) continue;
+        fprintf(out, "0x%04X %10llu calls %12llu %6.2f%% %12llu %6.2f%%\n", a, (unsigned long long)profile->calls[a],
+                (unsigned long long)inclusive[a], 100.0 * inclusive[a] / total,
+                (unsigned long long)profile->exclusive[a], 100.0 * profile->exclusive[a] / total);
+    }
+
+    fprintf(out, "-- loops --\n");
+    for (uint32_t i = 0; i < n; i++)
+    {
+        const uint16_t addr = addrs[i];
+        const uint16_t opcode = profile_opcode(chip8, addr);
+        const uint16_t target = opcode & 0x0FFF;
+        if ((opcode >> 12) != 0x1 || target > addr) continue;
+
+        uint64_t body = 0;
+        for (uint16_t a = target; a <= addr; a++) body += profile->pc[a];
+        fprintf(out, "0x%04X-0x%04X %12llu iterations %6.2f%% of time%s\n", target, addr,
+                (unsigned long long)profile->pc[addr], 100.0 * body / total,
+                target == addr ? " (spin)" : "");
+    }
+
+    fprintf(out, "-- self-modifying code: %llu rewritten instructions executed --\n",
+            (unsigned long long)profile->total_rewrites);
+    for (uint32_t a = 0; a < RAM_SIZE; a++)
+    {
+        if (!profile->rewrites[a]) continue;
+        char desc[128];
+        disassemble_instruction(profile->code[a] >> 16, desc, sizeof desc);
+        fprintf(out, "0x%04X %12llu rewrites, last 0x%04X  %s\n", a, (unsigned long long)profile->rewrites[a],
+                profile->code[a] >> 16, desc);
+    }
+}
+
+// write every executed address as CSV when path ends in .csv, otherwise JSON
+bool profile_write(const chip8_profile_t *profile, const chip8_t *chip8, const char *path)
+{
+    FILE *out = fopen(path, "w");
+    if (!out)
+    {
+        SDL_Log("Could not open profile output %s\n", path);
+        return false;
+    }
+
+    static uint16_t addrs[RAM_SIZE];
+    const uint32_t n = profile_sorted(profile, addrs);
+    const size_t len = strlen(path);
+    const bool csv = len >= 4 && !strcmp(path + len - 4, ".csv");
+
+    if (csv) fprintf(out, "address,opcode,count,rewrites,disassembly\n");
+    else
+    {
+        fprintf(out, "{\n  \"total\": %llu,\n  \"rewrites\": %llu,\n  \"op_classes\": {",
+                (unsigned long long)profile->total, (unsigned long long)profile->total_rewrites);
+        for (uint8_t c = 0; c < 16; c++)
+        {
+            fprintf(out, "%s\"%X\": %llu", c ? ", " : "", c, (unsigned long long)profile->op_class[c]);
+        }
+        fprintf(out, "},\n  \"addresses\": [");
+    }
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        const uint16_t opcode = profile_opcode(chip8, addrs[i]);
+        char desc[128];
+        disassemble_instruction(opcode, desc, sizeof desc);
+
+        if (csv)
+        {
+            fprintf(out, "0x%04X,0x%04X,%llu,%llu,\"%s\"\n", addrs[i], opcode, (unsigned long long)profile->pc[addrs[i]],
+                    (unsigned long long)profile->rewrites[addrs[i]], desc);
+        }
+        else
+        {
+            fprintf(out, "%s\n    {\"address\": %u, \"opcode\": %u, \"count\": %llu, \"rewrites\": %llu, \"disassembly\": \"%s\"}",
+                    i ? "," : "", addrs[i], opcode, (unsigned long long)profile->pc[addrs[i]],
+                    (unsigned long long)profile->rewrites[addrs[i]], desc);
+        }
+    }
+
+    if (!csv) fprintf(out, "\n  ]\n}\n");
+    fclose(out);
+    return true;
+}
+
+// write the call paths in collapsed stack format ("main;sub_02A0;sub_031C 1234" per line),
+// which flamegraph.pl, speedscope and inferno read directly
+bool profile_write_collapsed(const chip8_profile_t *profile, const char *path)
+{
+    FILE *out = fopen(path, "w");
+    if (!out)
+    {
+        SDL_Log("Could not open flamegraph output %s\n", path);
+        return false;
+    }
+
+    for (uint32_t n = 0; n < profile->num_nodes; n++)
+    {
+        if (!profile->nodes[n].self) continue;
+
+        uint32_t path_nodes[PROFILE_MAX_DEPTH + 1];
+        uint32_t depth = 0;
+        for (uint32_t i = n; i != 0; i = profile->nodes[i].parent) path_nodes[depth++] = i;
+
+        fprintf(out, "main");
+        while (depth) fprintf(out, ";sub_%04X", profile->nodes[path_nodes[--depth]].addr);
+        fprintf(out, " %llu\n", (unsigned long long)profile->nodes[n].self);
+    }
+
+    fclose(out);
+    return true;
+}
+
+// - - - - - - - - -
+// METRICS
+// - - - - - - - - -
+
+static uint32_t hist_index(uint64_t value)
+{
+    if (value < HIST_SUB_BUCKETS) return (uint32_t)value;
+
+    uint32_t msb = HIST_SUB_BITS;
+    while (msb < 63 && (value >> (msb + 1))) msb++;
+    const uint32_t shift = msb - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB_BUCKETS + ((value >> shift) & (HIST_SUB_BUCKETS - 1));
+}
+
+// smallest value that lands in a bucket
+static uint64_t hist_lower(uint32_t index)
+{
+    if (index < HIST_SUB_BUCKETS) return index;
+
+    const uint32_t shift = index / HIST_SUB_BUCKETS - 1;
+    return (uint64_t)(HIST_SUB_BUCKETS + index % HIST_SUB_BUCKETS) << shift;
+}
+
+void hist_record(histogram_t *h, uint64_t value)
+{
+    h->counts[hist_index(value)]++;
+    if (h->count == 0 || value < h->min) h->min = value;
+    if (value > h->max) h->max = value;
+    h->count++;
+    h->sum += value;
+}
+
+// value at percentile p (0-100), reported as the middle of its bucket
+uint64_t hist_percentile(const histogram_t *h, double p)
+{
+    if (h->count == 0) return 0;
+
+    const uint64_t rank = (uint64_t)(p / 100.0 * (h->count - 1)) + 1;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < HIST_BUCKETS; i++)
+    {
+        seen += h->counts[i];
+        if (seen >= rank)
+        {
+            const uint64_t mid = (hist_lower(i) + (i + 1 < HIST_BUCKETS ? hist_lower(i + 1) : h->max + 1) - 1) / 2;
+            return mid < h->min ? h->min : mid > h->max ? h->max : mid;
+        }
+    }
+    return h->max;
+}
+
+static uint64_t ticks_to_us(uint64_t ticks)
+{
+    return ticks * 1000000 / SDL_GetPerformanceFrequency();
+}
+
+// record one frame; timestamps are performance counter values taken around each phase. A frame
+// skipped by frame_skip_t (shown false) has no render or present, and frame_skip is the N in use
+void metrics_frame(metrics_t *m, uint32_t instructions, uint64_t emulate_start, uint64_t emulate_end,
+                   double requested_delay_ms, uint64_t woke, bool shown, uint64_t rendered, uint64_t presented,
+                   uint32_t frame_skip)
+{
+    const uint64_t slept = ticks_to_us(woke - emulate_end);
+    const uint64_t requested = (uint64_t)(requested_delay_ms * 1000.0);
+
+    hist_record(&m->emulate, ticks_to_us(emulate_end - emulate_start));
+    hist_record(&m->overshoot, slept > requested ? slept - requested : 0);
+    hist_record(&m->instructions, instructions);
+    m->frames++;
+    m->period_frames++;
+    m->period_instructions += instructions;
+    m->frame_skip = frame_skip;
+
+    metrics_live_t *live = &m->live;
+    atomic_store_explicit(&live->instructions, atomic_load_explicit(&live->instructions, memory_order_relaxed) + instructions, memory_order_relaxed);
+    atomic_store_explicit(&live->frames_emulated, m->frames, memory_order_relaxed);
+    atomic_store_explicit(&live->frame_skip, frame_skip, memory_order_relaxed);
+    if (!shown)
+    {
+        m->skipped++;
+        m->skipped_since_present++;
+        atomic_store_explicit(&live->frames_skipped, m->skipped, memory_order_relaxed);
+        return;
+    }
+
+    hist_record(&m->render, ticks_to_us(rendered - woke));
+    hist_record(&m->present, ticks_to_us(presented - rendered));
+    m->period_presents++;
+
+    // a gap of two or more 60hz periods between presents means frames were dropped, unless skipped
+    uint64_t dropped = 0;
+    if (m->last_present)
+    {
+        const uint64_t interval = ticks_to_us(presented - m->last_present);
+        hist_record(&m->frame, interval);
+        if (interval * 2 >= 3 * 16667) dropped = (interval + 8333) / 16667 - 1;
+        dropped = dropped > m->skipped_since_present ? dropped - m->skipped_since_present : 0;
+    }
+    m->last_present = presented;
+    m->skipped_since_present = 0;
+
+    atomic_store_explicit(&live->frames_presented, m->frames - m->skipped, memory_order_relaxed);
+    atomic_store_explicit(&live->frames_dropped, atomic_load_explicit(&live->frames_dropped, memory_order_relaxed) + dropped, memory_order_relaxed);
+}
+
+// pacing: a present shows the machine as it was at some emulation time 'shown' (a performance counter
+// value on the 60hz schedule). Evenly paced frames keep the same wait from that time to the present;
+// how much it changes from one new picture to the next is the judder a viewer sees. A shown of 0
+// starts over, for presents whose timing says nothing (the first, or one cut short)
+void metrics_pacing(metrics_t *m, uint64_t presented, uint64_t shown)
+{
+    if (shown == m->last_shown) return;
+    if (!shown)
+    {
+        m->last_shown = 0;
+        return;
+    }
+
+    const int64_t latency = (int64_t)(presented - shown);
+    if (m->last_shown)
+    {
+        const int64_t error = latency - m->latency;
+        hist_record(&m->pacing, ticks_to_us(error < 0 ? -error : error));
+    }
+    m->last_shown = shown;
+    m->latency = latency;
+}
+
+// one line of p50/p99/max per phase, e.g. for stdout or the window title
+void metrics_summary(const metrics_t *m, double fps, double shown_fps, char *buf, size_t size)
+{
+    snprintf(buf, size, "%.1f fps (%.1f shown, skip %u, %llu skipped) | emu %llu/%llu/%llu us | render %llu/%llu/%llu us | present %llu/%llu/%llu us | "
+                        "oversleep %llu/%llu/%llu us | pacing %llu/%llu/%llu us (p50/p99/max)", fps, shown_fps, m->frame_skip,
+             (unsigned long long)m->skipped,
+             (unsigned long long)hist_percentile(&m->emulate, 50), (unsigned long long)hist_percentile(&m->emulate, 99),
+             (unsigned long long)m->emulate.max,
+             (unsigned long long)hist_percentile(&m->render, 50), (unsigned long long)hist_percentile(&m->render, 99),
+             (unsigned long long)m->render.max,
+             (unsigned long long)hist_percentile(&m->present, 50), (unsigned long long)hist_percentile(&m->present, 99),
+             (unsigned long long)m->present.max,
+             (unsigned long long)hist_percentile(&m->overshoot, 50), (unsigned long long)hist_percentile(&m->overshoot, 99),
+             (unsigned long long)m->overshoot.max,
+             (unsigned long long)hist_percentile(&m->pacing, 50), (unsigned long long)hist_percentile(&m->pacing, 99),
+             (unsigned long long)m->pacing.max);
+}
+
+// once a second: fps over the period and a summary line to stdout and/or the window title
+void metrics_periodic(metrics_t *m, SDL_Window *window, bool to_stdout)
+{
+    const uint64_t now = SDL_GetPerformanceCounter();
+    if (m->period_start == 0) m->period_start = now;
+
+    const double elapsed = (double)(now - m->period_start) / SDL_GetPerformanceFrequency();
+    if (elapsed < 1.0) return;
+
+    char line[320];
+    metrics_summary(m, m->period_frames / elapsed, m->period_presents / elapsed, line, sizeof line);
+    if (to_stdout) printf("%s\n", line);
+    SDL_SetWindowTitle(window, STATS_OVERLAY ? line : "CHIP8 EMULATOR");
+
+    atomic_store_explicit(&m->live.ips, (uint64_t)(m->period_instructions / elapsed), memory_order_relaxed);
+    atomic_store_explicit(&m->live.frame_p50, hist_percentile(&m->frame, 50), memory_order_relaxed);
+    atomic_store_explicit(&m->live.frame_p90, hist_percentile(&m->frame, 90), memory_order_relaxed);
+    atomic_store_explicit(&m->live.frame_p99, hist_percentile(&m->frame, 99), memory_order_relaxed);
+    atomic_store_explicit(&m->live.pacing_p50, hist_percentile(&m->pacing, 50), memory_order_relaxed);
+    atomic_store_explicit(&m->live.pacing_p99, hist_percentile(&m->pacing, 99), memory_order_relaxed);
+
+    m->period_start = now;
+    m->period_frames = 0;
+    m->period_presents = 0;
+    m->period_instructions = 0;
+}
+
+static void hist_write_json(FILE *out, const char *name, const histogram_t *h, bool last)
+{
+    fprintf(out, "  \"%s\": {\"count\": %llu, \"mean\": %.2f, \"min\": %llu, \"p50\": %llu, \"p90\": %llu, "
+                 "\"p99\": %llu, \"p999\": %llu, \"max\": %llu, \"buckets\": [",
+            name, (unsigned long long)h->count, h->count ? (double)h->sum / h->count : 0.0, (unsigned long long)h->min,
+            (unsigned long long)hist_percentile(h, 50), (unsigned long long)hist_percentile(h, 90),
+            (unsigned long long)hist_percentile(h, 99), (unsigned long long)hist_percentile(h, 99.9),
+            (unsigned long long)h->max);
+
+    // non-empty buckets as [lowest value, count]
+    bool first = true;
+    for (uint32_t i = 0; i < HIST_BUCKETS; i++)
+    {
+        if (!h->counts[i]) continue;
+        fprintf(out, "%s[%llu, %llu]", first ? "" : ", ", (unsigned long long)hist_lower(i), (unsigned long long)h->counts[i]);
+        first = false;
+    }
+    fprintf(out, "]}%s\n", last ? "" : ",");
+}
+
+bool metrics_write_json(const metrics_t *m, const char *path)
+{
+    FILE *out = fopen(path, "w");
+    if (!out)
+    {
+        SDL_Log("Could not open stats output %s\n", path);
+        return false;
+    }
+
+    fprintf(out, "{\n  \"frames\": %llu,\n  \"frames_skipped\": %llu,\n", (unsigned long long)m->frames,
+            (unsigned long long)m->skipped);
+    hist_write_json(out, "frame_us", &m->frame, false);
+    hist_write_json(out, "emulate_us", &m->emulate, false);
+    hist_write_json(out, "render_us", &m->render, false);
+    hist_write_json(out, "present_us", &m->present, false);
+    hist_write_json(out, "overshoot_us", &m->overshoot, false);
+    hist_write_json(out, "pacing_us", &m->pacing, false);
+    hist_write_json(out, "instructions", &m->instructions, true);
+    fprintf(out, "}\n");
+
+    fclose(out);
+    return true;
+}
+
+// - - - - - - - - -
+// FRAME SKIP
+// - - - - - - - - -
+
+#define FRAME_LAG_MAX 8                   // frames behind the 60hz schedule before it starts over
+
+// fold one measurement into a moving average over roughly the last 8
+static void frame_skip_average(double *average, double sample_ms)
+{
+    *average += (sample_ms - *average) / 8;
+}
+
+// frames per present: enough that N frames of emulation and one render fit in N 60hz periods
+static void frame_skip_choose(frame_skip_t *fs)
+{
+    // a little headroom for sleeping late
+    const double period_ms = 0.9 * 1000.0 / 60;
+    const double slack_ms = period_ms - fs->emulate_ms;
+    const double frames = slack_ms > 0 ? fs->render_ms / slack_ms : MAX_FRAME_SKIP;
+
+    uint32_t every = (uint32_t)frames;
+    if (every < frames) every++;
+    fs->every = every < 1 ? 1 : every > MAX_FRAME_SKIP ? MAX_FRAME_SKIP : every;
+}
+
+// after a frame's instructions have run: whether to draw and present it
+bool frame_skip_emulated(frame_skip_t *fs, uint64_t emulate_ticks)
+{
+    frame_skip_average(&fs->emulate_ms, (double)emulate_ticks * 1000 / SDL_GetPerformanceFrequency());
+    frame_skip_choose(fs);
+    return ++fs->since_present >= fs->every;
+}
+
+// after a frame was drawn and presented
+void frame_skip_presented(frame_skip_t *fs, uint64_t render_ticks)
+{
+    frame_skip_average(&fs->render_ms, (double)render_ticks * 1000 / SDL_GetPerformanceFrequency());
+    frame_skip_choose(fs);
+    fs->since_present = 0;
+}
+
+// - - - - - - - - -
+// DISPLAY PACING
+// - - - - - - - - -
+
+// --vsync: the display's refresh period to start from, from its current mode (60hz if unknown)
+void pacer_init(display_pacer_t *pacer, SDL_Window *window, bool blend)
+{
+    SDL_DisplayMode mode;
+    int rate = 60;
+    if (SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(window), &mode) == 0 && mode.refresh_rate > 0)
+    {
+        rate = mode.refresh_rate;
+    }
+    SDL_Log("Presenting on vsync at %d hz%s\n", rate, blend ? ", blending frames" : "");
+
+    const uint64_t freq = SDL_GetPerformanceFrequency();
+    *pacer = (display_pacer_t){ .blend = blend, .frame_ticks = freq / 60, .refresh_ticks = freq / rate };
+}
+
+// whether the emulator's clock completes another frame by the coming refresh. Unblended, that is
+// the refresh nearest its completion, so jitter in when presents return can't move a frame that
+// completes right on a refresh back and forth. The clock starts over after a pause or a stall of
+// more than FRAME_LAG_MAX frames, with one frame due
+bool pacer_frame_due(display_pacer_t *pacer)
+{
+    const uint64_t now = SDL_GetPerformanceCounter();
+    if (pacer->vblank < now) pacer->vblank = now + pacer->refresh_ticks;
+    if (pacer->completed + FRAME_LAG_MAX * pacer->frame_ticks < pacer->vblank)
+    {
+        pacer->completed = pacer->vblank - pacer->frame_ticks;
+    }
+    const uint64_t margin = pacer->blend ? 0 : pacer->refresh_ticks / 2;
+    return pacer->completed + pacer->frame_ticks <= pacer->vblank + margin;
+}
+
+// a frame was emulated; without blending only the last one before a refresh is ever drawn
+void pacer_frame_done(display_pacer_t *pacer, SDL_Renderer *renderer, const chip8_t *chip8)
+{
+    pacer->completed += pacer->frame_ticks;
+    if (!pacer->blend && pacer_frame_due(pacer)) return;
+
+    const uint8_t next = pacer->latest ^ 1;
+    if (draw_display(renderer, &pacer->frames[next], chip8, &pacer->used[next])) pacer->latest = next;
+}
+
+// draw for the coming refresh and present, which waits for it; returns the emulation time shown,
+// or 0 for the first present, which isn't yet in step with the refresh
+uint64_t pacer_present(display_pacer_t *pacer, SDL_Renderer *renderer, uint64_t *rendered, uint64_t *presented)
+{
+    SDL_Texture *latest = pacer->frames[pacer->latest];
+    SDL_Texture *previous = pacer->frames[pacer->latest ^ 1];
+    uint64_t shown = pacer->completed;
+    uint8_t alpha = 255;
+    const bool crossfade = pacer->blend && previous;
+    if (pacer->blend)
+    {
+        // the refresh lands some way from the latest frame to the next one; showing that same way
+        // from the previous frame to the latest moves every refresh on by the same emulation time
+        const uint64_t since = pacer->vblank > pacer->completed ? pacer->vblank - pacer->completed : 0;
+        const uint64_t phase = since < pacer->frame_ticks ? since : pacer->frame_ticks;
+        shown = pacer->completed - pacer->frame_ticks + phase;
+        alpha = (uint8_t)(phase * 255 / pacer->frame_ticks);
+    }
+    if (crossfade)
+    {
+        SDL_SetTextureBlendMode(previous, SDL_BLENDMODE_NONE);
+        SDL_RenderCopy(renderer, previous, &pacer->used[pacer->latest ^ 1], NULL);
+    }
+    if (latest)
+    {
+        SDL_SetTextureBlendMode(latest, crossfade ? SDL_BLENDMODE_BLEND : SDL_BLENDMODE_NONE);
+        SDL_SetTextureAlphaMod(latest, crossfade ? alpha : 255);
+        SDL_RenderCopy(renderer, latest, &pacer->used[pacer->latest], NULL);
+    }
+    *rendered = SDL_GetPerformanceCounter();
+
+    SDL_RenderPresent(renderer);
+    *presented = SDL_GetPerformanceCounter();
+
+    // follow the refresh actually measured, over roughly the last 16 presents; a present that
+    // missed its refresh says nothing about the period
+    const uint64_t interval = *presented - pacer->last_present;
+    if (pacer->last_present && interval < pacer->refresh_ticks * 3 / 2)
+    {
+        pacer->refresh_ticks = pacer->refresh_ticks - pacer->refresh_ticks / 16 + interval / 16;
+    }
+    const bool first = !pacer->last_present;
+    pacer->last_present = *presented;
+    pacer->vblank = *presented + pacer->refresh_ticks;
+    return first ? 0 : shown;
+}
+
+// - - - - - - - - - -
+// METRICS ENDPOINT
+// - - - - - - - - - -
+
+// Prometheus text exposition format; returns the length written
+size_t metrics_render(const metrics_live_t *live, char *buf, size_t size)
+{
+    const int state = atomic_load_explicit(&live->state, memory_order_relaxed);
+    const int len = snprintf(buf, size,
+        "# HELP chip8_instructions_total Instructions executed.\n"
+        "# TYPE chip8_instructions_total counter\n"
+        "chip8_instructions_total %llu\n"
+        "# HELP chip8_frames_emulated_total 60hz frames emulated.\n"
+        "# TYPE chip8_frames_emulated_total counter\n"
+        "chip8_frames_emulated_total %llu\n"
+        "# HELP chip8_frames_presented_total Frames presented to the window.\n"
+        "# TYPE chip8_frames_presented_total counter\n"
+        "chip8_frames_presented_total %llu\n"
+        "# HELP chip8_frames_dropped_total 60hz frames that passed without a present, beyond those skipped.\n"
+        "# TYPE chip8_frames_dropped_total counter\n"
+        "chip8_frames_dropped_total %llu\n"
+        "# HELP chip8_frames_skipped_total 60hz frames emulated but not drawn, to keep to schedule.\n"
+        "# TYPE chip8_frames_skipped_total counter\n"
+        "chip8_frames_skipped_total %llu\n"
+        "# HELP chip8_frame_skip Frames per present chosen from the measured render time.\n"
+        "# TYPE chip8_frame_skip gauge\n"
+        "chip8_frame_skip %llu\n"
+        "# HELP chip8_frame_time_microseconds Interval between presents.\n"
+        "# TYPE chip8_frame_time_microseconds summary\n"
+        "chip8_frame_time_microseconds{quantile=\"0.5\"} %llu\n"
+        "chip8_frame_time_microseconds{quantile=\"0.9\"} %llu\n"
+        "chip8_frame_time_microseconds{quantile=\"0.99\"} %llu\n"
+        "# HELP chip8_pacing_error_microseconds Change in the wait from emulation time to present, between new pictures.\n"
+        "# TYPE chip8_pacing_error_microseconds summary\n"
+        "chip8_pacing_error_microseconds{quantile=\"0.5\"} %llu\n"
+        "chip8_pacing_error_microseconds{quantile=\"0.99\"} %llu\n"
+        "# HELP chip8_instructions_per_second Instructions executed per second, last second.\n"
+        "# TYPE chip8_instructions_per_second gauge\n"
+        "chip8_instructions_per_second %llu\n"
+        "# HELP chip8_state Emulator state.\n"
+        "# TYPE chip8_state gauge\n"
+        "chip8_state{state=\"running\"} %d\n"
+        "chip8_state{state=\"paused\"} %d\n"
+        "chip8_state{state=\"quit\"} %d\n",
+        (unsigned long long)atomic_load_explicit(&live->instructions, memory_order_relaxed),
+        (unsigned long long)atomic_load_explicit(&live->frames_emulated, memory_order_relaxed),
+        (unsigned long long)atomic_load_explicit(&live->frames_presented, memory_order_relaxed),
+        (unsigned long long)atomic_load_explicit(&live->frames_dropped, memory_order_relaxed),
+        (unsigned long long)atomic_load_explicit(&live->frames_skipped, memory_order_relaxed),
+        (unsigned long long)atomic_load_explicit(&live->frame_skip, memory_order_relaxed),
+        (unsigned long long)atomic_load_explicit(&live->frame_p50, memory_order_relaxed),
+        (unsigned long long)atomic_load_explicit(&live->frame_p90, memory_order_relaxed),
+        (unsigned long long)atomic_load_explicit(&live->frame_p99, memory_order_relaxed),
+        (unsigned long long)atomic_load_explicit(&live->pacing_p50, memory_order_relaxed),
+        (unsigned long long)atomic_load_explicit(&live->pacing_p99, memory_order_relaxed),
+        (unsigned long long)atomic_load_explicit(&live->ips, memory_order_relaxed),
+        state == RUNNING, state == PAUSED, state == QUIT);
+    return len < 0 ? 0 : (size_t)len < size ? (size_t)len : size - 1;
+}
+
+// the HTTP listener needs sockets (and -lws2_32 on windows), so it is opt in
+#ifdef CHIP8_METRICS_HTTP
+#ifdef _WIN32
+#include <winsock2.h>
+typedef SOCKET socket_t;
+#define close_socket closesocket
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int socket_t;
+#define INVALID_SOCKET -1
+#define close_socket close
+#endif
+
+typedef struct {
+    const metrics_live_t *live;
+    socket_t listener;
+    _Atomic bool running;
+    SDL_Thread *thread;
+} metrics_server_t;
+
+static void metrics_respond(const metrics_server_t *server, socket_t client)
+{
+    // a client that connects and never sends must not hold up metrics_server_stop
+    fd_set ready;
+    FD_ZERO(&ready);
+    FD_SET(client, &ready);
+    struct timeval timeout = { .tv_sec = 0, .tv_usec = 200000 };
+    if (select((int)client + 1, &ready, NULL, NULL, &timeout) <= 0) return;
+
+    char request[1024];
+    const int received = recv(client, request, sizeof request - 1, 0);
+    if (received <= 0) return;
+    request[received] = '\0';
+
+    char body[3072];
+    char response[3328];
+    int len;
+    if (!strncmp(request, "GET /metrics ", 13) || !strncmp(request, "GET / ", 6))
+    {
+        const size_t body_len = metrics_render(server->live, body, sizeof body);
+        len = snprintf(response, sizeof response, "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                       "Content-Length: %u\r\nConnection: close\r\n\r\n%s", (unsigned)body_len, body);
+    }
+    else
+    {
+        len = snprintf(response, sizeof response, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    }
+    send(client, response, len, 0);
+}
+
+static int metrics_serve(void *arg)
+{
+    metrics_server_t *server = arg;
+    while (atomic_load(&server->running))
+    {
+        // wake up regularly to notice shutdown
+        fd_set ready;
+        FD_ZERO(&ready);
+        FD_SET(server->listener, &ready);
+        struct timeval timeout = { .tv_sec = 0, .tv_usec = 200000 };
+        if (select((int)server->listener + 1, &ready, NULL, NULL, &timeout) <= 0) continue;
+
+        const socket_t client = accept(server->listener, NULL, NULL);
+        if (client == INVALID_SOCKET) continue;
+        metrics_respond(server, client);
+        close_socket(client);
+    }
+    return 0;
+}
+
+// serve metrics on http://127.0.0.1:port/metrics from a background thread
+bool metrics_server_start(metrics_server_t *server, const metrics_live_t *live, uint16_t port)
+{
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) return false;
+#endif
+    server->live = live;
+    server->listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (server->listener == INVALID_SOCKET)
+    {
+        SDL_Log("Could not create metrics socket\n");
+        return false;
+    }
+
+    const int reuse = 1;
+    setsockopt(server->listener, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof reuse);
+
+    // loopback only: the endpoint is for local scrapers
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(server->listener, (struct sockaddr *)&addr, sizeof addr) != 0 || listen(server->listener, 8) != 0)
+    {
+        SDL_Log("Could not listen for metrics on 127.0.0.1:%u\n", port);
+        close_socket(server->listener);
+        return false;
+    }
+
+    atomic_store(&server->running, true);
+    server->thread = SDL_CreateThread(metrics_serve, "metrics", server);
+    return true;
+}
+
+void metrics_server_stop(metrics_server_t *server)
+{
+    if (!atomic_load(&server->running)) return;
+
+    atomic_store(&server->running, false);
+    SDL_WaitThread(server->thread, NULL);
+    close_socket(server->listener);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+#endif
+
+// - - - - - - - - -
+// STATE HASHING
+// - - - - - - - - -
+
+// one multiply-xorshift round per 64 bit word; cheap enough to hash every explored state
+static inline uint64_t hash_mix(uint64_t h, uint64_t v)
+{
+    h = (h ^ v) * 0x9E3779B97F4A7C15ull;
+    return h ^ (h >> 29);
+}
+
+uint64_t hash_bytes(uint64_t h, const void *data, size_t len)
+{
+    const uint8_t *bytes = data;
+    uint64_t word;
+
+    for (; len >= 8; len -= 8, bytes += 8)
+    {
+        memcpy(&word, bytes, 8);
+        h = hash_mix(h, word);
+    }
+    word = 0;
+    memcpy(&word, bytes, len);
+    return hash_mix(h, word ^ len);
+}
+
+// content hash of everything that decides how a machine runs on:
+// ram, display, V, I, PC, stack, timers, faults, RPL flags and the random state (not the keypad)
+uint64_t hash_chip8(const chip8_t *chip8)
+{
+    uint64_t h = 0xCBF29CE484222325ull;
+
+    for (uint32_t p = 0; p < mem_pages(&chip8->mem); p++) h = hash_bytes(h, chip8->mem.page[p], RAM_PAGE_SIZE);
+    h = hash_bytes(h, chip8->display, display_bytes(chip8->display_planes, chip8->display_full));
+    h = hash_mix(h, chip8->hires | chip8->planes << 1);
+    h = hash_bytes(h, chip8->V, sizeof chip8->V);
+    h = hash_bytes(h, chip8->rpl, sizeof chip8->rpl);
+    h = hash_bytes(h, chip8->stack, chip8->stack_ptr * sizeof chip8->stack[0]);
+
+    const uint64_t regs = (uint64_t)chip8->I | (uint64_t)chip8->PC << 16 |
+                          (uint64_t)chip8->delay_timer << 32 | (uint64_t)chip8->sound_timer << 40 |
+                          (uint64_t)chip8->stack_ptr << 48 | (uint64_t)chip8->fault << 56;
+    h = hash_mix(h, regs);
+    return hash_mix(h, chip8->rng);
+}
+
+// hash of the visible picture only, one bit per pixel, 64 pixels at a time; golden files store
+// these. A lo-res picture hashes the same as it did when the display was a byte per pixel, and
+// the XO-CHIP planes past the first only count once something is drawn on them
+uint64_t hash_display(const display_plane_t *display, uint8_t planes, bool hires)
+{
+    const uint8_t width = hires ? DISPLAY_WIDTH : DISPLAY_WIDTH / 2;
+    const uint8_t height = hires ? DISPLAY_HEIGHT : DISPLAY_HEIGHT / 2;
+
+    uint64_t h = 0xCBF29CE484222325ull;
+    for (uint8_t p = 0; p < planes; p++)
+    {
+        display_row_t any = { 0, 0 };
+        for (uint8_t y = 0; y < height; y++) any = row_or(any, row_get(display, p, y, hires));
+        if (p && !row_any(any)) continue;
+
+        uint64_t bits = 0;
+        for (uint8_t y = 0; y < height; y++)
+        {
+            for (uint8_t x = 0; x < width; x += 64)
+            {
+                bits = x ? display[p].lo[y] : display[p].hi[y];
+                h = hash_mix(h, bits);
+            }
+        }
+        h = hash_mix(h, bits ^ ((uint32_t)width * height) ^ ((uint64_t)p << 32));
+    }
+    return h;
+}
+
+// fold ram and display into h; only pages and display bands written since the last call are rehashed.
+// A display that isn't full has only the left words of the top half of the bands
+uint64_t hash_memory_incremental(uint64_t h, hash_cache_t *cache, chip8_mem_t *mem, const display_plane_t *display,
+                                 uint8_t display_planes, bool display_full, bool hires, uint8_t planes,
+                                 uint8_t *display_written)
+{
+    const uint8_t bands = cache->valid ? *display_written : 0xFF;
+    const uint32_t band_size = DISPLAY_BAND_ROWS * sizeof display[0].hi[0];
+    const uint32_t bands_held = display_full ? DISPLAY_BANDS : DISPLAY_BANDS / 2;
+
+    for (uint32_t p = 0; p < mem_pages(mem); p++)
+    {
+        if (!cache->valid || page_test(&mem->written, p)) cache->ram[p] = hash_bytes(p, mem->page[p], RAM_PAGE_SIZE);
+        h = hash_mix(h, cache->ram[p]);
+    }
+    for (uint32_t b = 0; b < DISPLAY_BANDS; b++)
+    {
+        if (bands & (1u << b))
+        {
+            cache->display[b] = b;
+            for (uint8_t p = 0; p < display_planes && b < bands_held; p++)
+            {
+                cache->display[b] = hash_bytes(cache->display[b], &display[p].hi[b * DISPLAY_BAND_ROWS], band_size);
+                if (display_full)
+                {
+                    cache->display[b] = hash_bytes(cache->display[b], &display[p].lo[b * DISPLAY_BAND_ROWS], band_size);
+                }
+            }
+        }
+        h = hash_mix(h, cache->display[b]);
+    }
+    h = hash_mix(h, hires | planes << 1);
+
+    page_fill(&mem->written, false);
+    *display_written = 0;
+    cache->valid = true;
+    return h;
+}
+
+// registers for incremental state hashes, laid out the same whatever core they come from
+uint64_t hash_registers(uint64_t h, const uint8_t V[16], uint16_t I, uint16_t PC, const uint16_t stack[STACK_DEPTH],
+                       uint8_t depth, uint8_t delay_timer, uint8_t sound_timer, uint8_t fault, uint32_t rng,
+                       const uint8_t rpl[RPL_FLAGS])
+{
+    h = hash_bytes(h, V, 16);
+    h = hash_bytes(h, rpl, RPL_FLAGS);
+    h = hash_bytes(h, stack, depth * sizeof stack[0]);
+    h = hash_mix(h, (uint64_t)I | (uint64_t)PC << 16 | (uint64_t)delay_timer << 32 |
+                    (uint64_t)sound_timer << 40 | (uint64_t)depth << 48 | (uint64_t)fault << 56);
+    return hash_mix(h, rng);
+}
+
+// same state as hash_chip8 covers, but cheap to take often: see hash_memory_incremental.
+// Different cores hash equal states to equal values, so they can be compared in lockstep
+uint64_t hash_chip8_incremental(chip8_t *chip8, hash_cache_t *cache)
+{
+    uint64_t h = hash_memory_incremental(0xCBF29CE484222325ull, cache, &chip8->mem, chip8->display,
+                                         chip8->display_planes, chip8->display_full, chip8->hires, chip8->planes,
+                                         &chip8->display_written);
+    return hash_registers(h, chip8->V, chip8->I, chip8->PC, chip8->stack, chip8->stack_ptr,
+                          chip8->delay_timer, chip8->sound_timer, chip8->fault, chip8->rng, chip8->rpl);
+}
+
+// - - - - - - - - -
+// BATCH CORE (SoA)
+// - - - - - - - - -
+
+// lane mask helpers: masks are all ones for active lanes and zero otherwise,
+// so every register update is a branch-free blend the compiler can vectorize
+#define LANE_SELECT(mask, new_val, old_val) (((new_val) & (mask)) | ((old_val) & ~(mask)))
+
+// bytes each lane's taken skip would move PC past, read before the lane loop so the loop itself
+// is only blends; outside XO-CHIP that is always 2 and nothing is read
+static ALWAYS_INLINE void batch_skip_sizes(const chip8_batch_t *batch, uint16_t *skip, const chip8_quirks_t quirks)
+{
+    for (uint32_t l = 0; l < BATCH_LANES; l++) skip[l] = skip_size(&batch->mem[l], batch->PC[l], quirks);
+}
+
+// 8XYN flags into VF on the masked lanes; with only_set a clear flag leaves VF, as set_flag
+static ALWAYS_INLINE void batch_set_flag(uint8_t *VF, const uint8_t *flag, const uint16_t *mask, bool only_set)
+{
+    for (uint32_t l = 0; l < BATCH_LANES; l++)
+    {
+        const uint8_t write = (uint8_t)mask[l] & (only_set ? (uint8_t)-flag[l] : 0xFF);
+        VF[l] = LANE_SELECT(write, flag[l], VF[l]);
+    }
+}
+
+// the lanes whose mask is set, in order, for the side effects a blend cannot express: memory
+// writes and recorded draws. Returns how many there are
+static ALWAYS_INLINE uint32_t batch_active_lanes(const uint16_t *mask, uint8_t *lanes)
+{
+    uint32_t count = 0;
+    for (uint32_t l = 0; l < BATCH_LANES; l++)
+    {
+        lanes[count] = l;
+        count += mask[l] != 0;
+    }
+    return count;
+}
+
+// - deferred drawing -
+// With defer_draws set a lane's DXYN only records its operands. Frame-skipped runs never look
+// at most frames, so the sprites are drawn when something needs the display: a scroll, a
+// memory write, a hash, an observation or copying the lane out. A clear drops the draws it
+// would wipe unseen, and two equal draws cancel (XOR), so most are never rasterized. When an
+// instruction reads VF the last draw's collision is worked out on its own, without drawing
+
+// draw a lane's recorded sprites in order; VF ends up as drawing them one by one would leave it
+static ALWAYS_INLINE void draw_list_flush(draw_list_t *list, display_plane_t *display, chip8_mem_t *mem, bool hires,
+                                          uint8_t *VF, uint8_t *display_written, const chip8_quirks_t quirks)
+{
+    uint8_t carry = 0;
+    for (uint8_t d = 0; d < list->count; d++)
+    {
+        const deferred_draw_t *draw = &list->draw[d];
+        carry = draw_sprite(display, mem, draw->I, draw->VX, draw->VY, draw->N, hires, draw->planes, quirks);
+        *display_written |= display_bands(draw->VY, sprite_rows(draw->N, quirks), hires, quirks.wrap_sprites);
+    }
+    if (list->vf_pending) *VF = carry;
+    list->count = 0;
+    list->vf_pending = false;
+    list->keys = 0;
+}
+
+// VF for the last recorded draw: its sprite against the rows under it, as they stand once the
+// draws before it are XORed in. Only the rows it covers are built; nothing is drawn
+static void draw_list_resolve_vf(draw_list_t *list, const display_plane_t *display, chip8_mem_t *mem, bool hires,
+                                 uint8_t *VF, const chip8_quirks_t quirks)
+{
+    if (!list->vf_pending) return;
+    list->vf_pending = false;
+
+    const uint8_t height = hires ? DISPLAY_HEIGHT : DISPLAY_HEIGHT / 2;
+    const deferred_draw_t *last = &list->draw[list->count - 1];
+    const sprite_place_t at = place_sprite(last->VX, last->VY, last->N, hires, quirks);
+
+    display_row_t carry = { 0, 0 };
+    for (uint8_t p = 0; p < DISPLAY_PLANES; p++)
+    {
+        if (!(last->planes & (1 << p))) continue;
+
+        display_row_t under[SPRITE_MAX_ROWS], scratch[SPRITE_MAX_ROWS];
+        for (uint8_t i = 0; i < at.visible; i++) under[i] = row_get(display, p, (at.top + i) % height, quirks.schip);
+
+        for (uint8_t d = 0; d + 1 < list->count; d++)
+        {
+            const deferred_draw_t *draw = &list->draw[d];
+            if (!(draw->planes & (1 << p))) continue;
+
+            const sprite_place_t over = place_sprite(draw->VX, draw->VY, draw->N, hires, quirks);
+            const display_row_t *rows = NULL;
+            for (uint8_t i = 0; i < at.visible; i++)
+            {
+                // the earlier sprite's row on display row top + i, if it reaches that far
+                const uint8_t j = (at.top + i + height - over.top) % height;
+                if (j >= over.visible) continue;
+                if (!rows) rows = shifted_sprite(mem, sprite_plane_data(draw->I, over, draw->planes, p), over.rows,
+                                                 over.wide, over.X, hires, quirks.wrap_sprites, scratch);
+                under[i] = row_xor(under[i], rows[j]);
+            }
+        }
+
+        // fetched last, as fetching the earlier sprites may evict its cache entry
+        const display_row_t *sprite = shifted_sprite(mem, sprite_plane_data(last->I, at, last->planes, p), at.rows,
+                                                     at.wide, at.X, hires, quirks.wrap_sprites, scratch);
+        for (uint8_t i = 0; i < at.visible; i++) carry = row_or(carry, row_and(under[i], sprite[i]));
+    }
+    *VF = row_any(carry);
+}
+
+// one of 64 bits for a draw, for draw_list_t.keys
+static ALWAYS_INLINE uint64_t draw_key(const deferred_draw_t draw)
+{
+    const uint32_t h = ((uint32_t)draw.I ^ (uint32_t)draw.VX << 8 ^ (uint32_t)draw.VY << 16 ^ (uint32_t)draw.N << 24 ^
+                        (uint32_t)draw.planes << 28) * 0x9E3779B1u;
+    return 1ull << (h >> 26);
+}
+
+// record a DXYN, whose VF replaces the last draw's. Now that the last draw's VF is settled
+// (read, or never to be), a draw equal to it that is still pending undoes it, and both go
+static ALWAYS_INLINE void draw_list_append(draw_list_t *list, const deferred_draw_t draw)
+{
+    if (list->count)
+    {
+        const deferred_draw_t last = list->draw[list->count - 1];
+        const uint64_t key = draw_key(last);
+        bool twin = false;
+        for (uint8_t d = 0; (list->keys & key) && d + 1 < list->count; d++)
+        {
+            if (memcmp(&list->draw[d], &last, sizeof last)) continue;
+
+            memmove(&list->draw[d], &list->draw[d + 1], (list->count - 2 - d) * sizeof list->draw[0]);
+            list->count -= 2;
+            list->keys = 0;
+            for (uint8_t k = 0; k < list->count; k++) list->keys |= draw_key(list->draw[k]);
+            twin = true;
+            break;
+        }
+        if (!twin) list->keys |= key;
+    }
+    list->draw[list->count++] = draw;
+    list->vf_pending = true;
+}
+
+static ALWAYS_INLINE void batch_flush_lane_impl(chip8_batch_t *batch, uint32_t lane, const chip8_quirks_t quirks)
+{
+    draw_list_flush(&batch->draws[lane], batch->display[lane], &batch->mem[lane], batch->hires[lane],
+                    &batch->V[0xF][lane], &batch->display_written[lane], quirks);
+}
+
+// draw whatever a deferring lane has recorded, so its display and VF are up to date
+void batch_flush_lane(chip8_batch_t *batch, uint32_t lane)
+{
+    if (!batch->draws[lane].count) return;
+#define SPECIALIZE(quirks) batch_flush_lane_impl(batch, lane, quirks)
+    DISPATCH_PLATFORM(batch->platform)
+#undef SPECIALIZE
+}
+
+// before a deferring batch runs an opcode: work out VF where it is about to be read, forget it
+// where it is about to be overwritten, and draw or drop the draws the opcode would disturb
+static ALWAYS_INLINE void batch_defer_prepare(chip8_batch_t *batch, const uint16_t opcode, const uint16_t *mask,
+                                              const chip8_quirks_t quirks)
+{
+    const uint8_t top = opcode >> 12;
+    const uint8_t X = (opcode >> 8) & 0x0F;
+    const uint8_t Y = (opcode >> 4) & 0x0F;
+    const uint8_t N = opcode & 0x0F;
+
+    // most opcodes touch neither VF, the display nor memory
+    if (X != 0xF && Y != 0xF && top != 0x0 && top != 0x5 && top != 0x8 && top != 0xD && top != 0xF) return;
+
+    const opcode_id_t id = opcode_id(opcode);
+    const bool uses_vy = top == 0x5 || top == 0x8 || top == 0x9 || top == 0xD;
+    const bool reads_vf = top == 0xB ? quirks.jump_vx && X == 0xF
+                        : top != 0x0 && top != 0x1 && top != 0x2 && top != 0xA && (X == 0xF || (uses_vy && Y == 0xF));
+    // 8XYN flag results replace VF unread
+    const bool writes_vf = top == 0x8 && ((N == 0x4 && quirks.vf_clear_on_no_carry) || (N >= 0x5 && N <= 0x7) || N == 0xE ||
+                                          (quirks.vf_reset && N >= 0x1 && N <= 0x3));
+    const bool disturbs = id == OP_SCD || id == OP_SCU || id == OP_SCR || id == OP_SCL ||
+                          id == OP_LD_B || id == OP_STORE || id == OP_ST_XY;
+    const bool clears = id == OP_CLS || ((id == OP_LOW || id == OP_HIGH) && quirks.schip);
+    const bool draws = id == OP_DRW || id == OP_DRW16;
+    if (!reads_vf && !writes_vf && !disturbs && !clears && !draws) return;
+
+    for (uint32_t l = 0; l < BATCH_LANES; l++)
+    {
+        draw_list_t *list = &batch->draws[l];
+        if (!mask[l] || !list->count) continue;
+
+        if (reads_vf || clears)
+        {
+            draw_list_resolve_vf(list, batch->display[l], &batch->mem[l], batch->hires[l], &batch->V[0xF][l], quirks);
+        }
+        else if (writes_vf) list->vf_pending = false;
+
+        bool dropped = clears;
+        if (id == OP_CLS)
+        {
+            const uint8_t cleared = active_planes(batch->planes[l], quirks);
+            for (uint8_t d = 0; d < list->count; d++) dropped &= (list->draw[d].planes & ~cleared) == 0;
+        }
+
+        if (dropped)
+        {
+            list->count = 0;
+            list->keys = 0;
+        }
+        else if (disturbs || clears || (draws && list->count == DEFERRED_DRAWS))
+        {
+            batch_flush_lane_impl(batch, l, quirks);
+        }
+    }
+}
+
+// copy one chip8 machine into a lane of the batch; the lane shares the machine's image
+void batch_set_lane(chip8_batch_t *batch, uint32_t lane, const chip8_t *chip8)
+{
+    for (uint8_t i = 0; i < 16; i++) batch->V[i][lane] = chip8->V[i];
+    for (uint8_t i = 0; i < STACK_DEPTH; i++) batch->stack[i][lane] = chip8->stack[i];
+
+    batch->I[lane] = chip8->I;
+    batch->PC[lane] = chip8->PC;
+    batch->delay_timer[lane] = chip8->delay_timer;
+    batch->sound_timer[lane] = chip8->sound_timer;
+    batch->stack_ptr[lane] = chip8->stack_ptr;
+    batch->fault[lane] = chip8->fault;
+    batch->exited[lane] = chip8->state == QUIT;
+    batch->rng[lane] = chip8->rng;
+
+    memcpy(batch->keypad[lane], chip8->keypad, sizeof chip8->keypad);
+    mem_free(&batch->mem[lane]);
+    mem_clone(&batch->mem[lane], &chip8->mem);
+    memcpy(batch->display[lane], chip8->display, display_bytes(batch->display_planes, batch->display_full));
+    batch->display_written[lane] = 0xFF;
+    batch->hires[lane] = chip8->hires;
+    batch->planes[lane] = chip8->planes;
+    memcpy(batch->rpl[lane], chip8->rpl, sizeof chip8->rpl);
+    batch->draws[lane].count = 0;
+    batch->draws[lane].vf_pending = false;
+    batch->draws[lane].keys = 0;
+}
+
+// copy a lane of the batch back out into a chip8 machine, e.g. for rendering or debugging;
+// release it with free_chip8
+void batch_get_lane(const chip8_batch_t *batch, uint32_t lane, chip8_t *chip8)
+{
+    for (uint8_t i = 0; i < 16; i++) chip8->V[i] = batch->V[i][lane];
+    for (uint8_t i = 0; i < STACK_DEPTH; i++) chip8->stack[i] = batch->stack[i][lane];
+
+    chip8->I = batch->I[lane];
+    chip8->PC = batch->PC[lane];
+    chip8->delay_timer = batch->delay_timer[lane];
+    chip8->sound_timer = batch->sound_timer[lane];
+    chip8->stack_ptr = batch->stack_ptr[lane];
+    chip8->fault = batch->fault[lane];
+    if (batch->exited[lane]) chip8->state = QUIT;
+    chip8->rng = batch->rng[lane];
+    chip8->platform = batch->platform;
+
+    memcpy(chip8->keypad, batch->keypad[lane], sizeof chip8->keypad);
+    chip8->own_image = NULL;
+    mem_clone(&chip8->mem, &batch->mem[lane]);
+    chip8->display = NULL;
+    display_resize(&chip8->display, &chip8->display_planes, &chip8->display_full, batch->display_planes,
+                   batch->display_full);
+    memcpy(chip8->display, batch->display[lane], display_bytes(batch->display_planes, batch->display_full));
+    chip8->display_written = 0xFF;
+    chip8->hires = batch->hires[lane];
+    chip8->planes = batch->planes[lane];
+    memcpy(chip8->rpl, batch->rpl[lane], sizeof chip8->rpl);
+
+    // a deferring lane's recorded draws land on the copy
+    draw_list_t draws = batch->draws[lane];
+    draw_list_flush(&draws, chip8->display, &chip8->mem, chip8->hires, &chip8->V[0xF], &chip8->display_written,
+                    platform_quirks[batch->platform]);
+}
+
+// hash_chip8_incremental for one lane of a batch
+uint64_t hash_batch_lane_incremental(chip8_batch_t *batch, uint32_t lane, hash_cache_t *cache)
+{
+    batch_flush_lane(batch, lane);
+
+    uint8_t V[16];
+    uint16_t stack[STACK_DEPTH];
+    for (uint8_t i = 0; i < 16; i++) V[i] = batch->V[i][lane];
+    for (uint8_t i = 0; i < STACK_DEPTH; i++) stack[i] = batch->stack[i][lane];
+
+    uint64_t h = hash_memory_incremental(0xCBF29CE484222325ull, cache, &batch->mem[lane], batch->display[lane],
+                                         batch->display_planes, batch->display_full, batch->hires[lane], batch->planes[lane],
+                                         &batch->display_written[lane]);
+    return hash_registers(h, V, batch->I[lane], batch->PC[lane], stack, batch->stack_ptr[lane],
+                          batch->delay_timer[lane], batch->sound_timer[lane], batch->fault[lane], batch->rng[lane],
+                          batch->rpl[lane]);
+}
+
+// start every lane of a zeroed batch on one image; the image must outlive the batch
+void init_chip8_batch(chip8_batch_t *batch, const chip8_image_t *image, char *rom_name)
+{
+    chip8_t chip8 = {0};
+    init_chip8_shared(&chip8, image, rom_name);
+    batch->platform = chip8.platform;
+
+    for (uint32_t lane = 0; lane < BATCH_LANES; lane++)
     {
-        SDL_Log("ROM file %s is too large. ROM size: %d, Max Size allowed: %d\n", rom_name, (int)rom_size, (int)max_size);
-        return false;
+        display_resize(&batch->display[lane], &batch->display_planes, &batch->display_full, chip8.display_planes,
+                       chip8.display_full);
+        batch_set_lane(batch, lane, &chip8);
     }
+    free_chip8(&chip8);
+}
 
-    // Load ROM
-    if (fread(&chip8->ram[entry_point], rom_size, 1, rom) != 1)
+// release every lane's private ram pages and display
+void free_chip8_batch(chip8_batch_t *batch)
+{
+    for (uint32_t lane = 0; lane < BATCH_LANES; lane++)
     {
-        SDL_Log("Could not read ROM file %s into CHIP8 memory\n", rom_name);
-        return false;
+        mem_free(&batch->mem[lane]);
+        free(batch->display[lane]);
+        batch->display[lane] = NULL;
     }
-
-    // close the stream
-    fclose(rom);
-
-    // set chip8 machine defaults
-    chip8->state = RUNNING;             // default machine state
-    chip8->PC = entry_point;            // start program counter
-    chip8->rom_name = rom_name;         // rom name
-    chip8->stack_ptr = &chip8->stack[0];// stack ptr
-
-    return true;
 }
 
-// emulate the CHIP-8 Instruction set
-void emulate_instruction(chip8_t *chip8)
+// execute one opcode on every lane whose mask is set; quirks are constants, as in emulate_instruction_impl
+static ALWAYS_INLINE void batch_execute(chip8_batch_t *batch, const uint16_t opcode, const uint16_t *mask,
+                                        const chip8_quirks_t quirks)
 {
-    // get next opcode from RAM
-    chip8->inst.opcode = (chip8->ram[chip8->PC] << 8) | chip8->ram[chip8->PC+1];
-    // pre-increment program counter for next opcode
-    chip8->PC += 2;
+    const uint16_t NNN = opcode & 0x0FFF;
+    const uint8_t NN = opcode & 0x0FF;
+    const uint8_t N = opcode & 0x0F;
+    const uint8_t X = (opcode >> 8) & 0x0F;
+    const uint8_t Y = (opcode >> 4) & 0x0F;
+
+    uint8_t *VX = batch->V[X];
+    uint8_t *VY = batch->V[Y];
+    uint8_t *VF = batch->V[0xF];
+    const uint8_t *SRC = quirks.shift_vy ? VY : VX;   // operand of 8XY6/8XYE
+    uint8_t flag[BATCH_LANES];                        // 8XYN flags, written to VF after VX
+    uint16_t skip[BATCH_LANES];                       // skip sizes, see batch_skip_sizes
+    uint8_t lanes[BATCH_LANES];                       // active lanes, see batch_active_lanes
+
+    if (batch->defer_draws) batch_defer_prepare(batch, opcode, mask, quirks);
+
+    switch (opcode_id(opcode))
+    {
+        case OP_CLS:
+            // 0x00E0: Clear the screen (the selected planes on XO-CHIP)
+            for (uint32_t l = 0; l < BATCH_LANES; l++)
+            {
+                clear_planes(batch->display[l], active_planes(batch->planes[l], quirks) & (uint8_t)mask[l], quirks);
+                batch->display_written[l] |= (uint8_t)mask[l];
+            }
+            break;
 
-    // fill out most recent instruction format
-    chip8->inst.NNN = chip8->inst.opcode & 0x0FFF;
-    chip8->inst.NN = chip8->inst.opcode & 0x0FF;
-    chip8->inst.N = chip8->inst.opcode & 0x0F;
-    chip8->inst.X = (chip8->inst.opcode >> 8) & 0x0F;
-    chip8->inst.Y = (chip8->inst.opcode >> 4) & 0x0F;
+        case OP_RET:
+            // 0x00EE: Return from subroutine
+            for (uint32_t l = 0; l < BATCH_LANES; l++)
+            {
+                const uint8_t sp = (batch->stack_ptr[l] - 1) & (STACK_DEPTH - 1);
+                batch->fault[l] |= (batch->stack_ptr[l] == 0) * FAULT_STACK_UNDERFLOW & (uint8_t)mask[l];
+                batch->stack_ptr[l] = LANE_SELECT((uint8_t)mask[l], sp, batch->stack_ptr[l]);
+                batch->PC[l] = LANE_SELECT(mask[l], batch->stack[sp][l], batch->PC[l]);
+            }
+            break;
 
-#ifdef DEBUG
-    print_debug_info(chip8);
-#endif
+        case OP_SCD:
+            // 0x00CN: Scroll the display down N pixels (SCHIP)
+            if (!quirks.schip) break;
+            for (uint32_t l = 0; l < BATCH_LANES; l++)
+            {
+                const uint8_t planes = active_planes(batch->planes[l], quirks) & (uint8_t)mask[l];
+                scroll_vertical(batch->display[l], N, batch->hires[l], planes, quirks);
+                batch->display_written[l] |= (uint8_t)mask[l];
+            }
+            break;
 
-    // emulate opcode
-    switch ((chip8->inst.opcode >> 12) & 0x0F)
-    {
-        case 0x00:                       // if the top 12 bits are zero
-            if (chip8->inst.NN == 0xE0)  // if the lowest 12 are
+        case OP_SCU:
+            // 0x00DN: Scroll the display up N pixels (XO-CHIP)
+            if (!quirks.xochip) break;
+            for (uint32_t l = 0; l < BATCH_LANES; l++)
+            {
+                scroll_vertical(batch->display[l], -N, batch->hires[l], batch->planes[l] & (uint8_t)mask[l], quirks);
+                batch->display_written[l] |= (uint8_t)mask[l];
+            }
+            break;
+
+        case OP_SCR:
+        case OP_SCL:
+            // 0x00FB/0x00FC: Scroll the display right/left 4 pixels (SCHIP)
+            if (!quirks.schip) break;
+            for (uint32_t l = 0; l < BATCH_LANES; l++)
             {
-                // 0x00E: Clear the screen
-                // set the display memory to clear the screen
-                memset(&chip8->display[0], false, sizeof chip8->display);
+                scroll_across(batch->display[l], opcode == 0x00FB ? 4 : -4, batch->hires[l],
+                              active_planes(batch->planes[l], quirks) & (uint8_t)mask[l], quirks);
+                batch->display_written[l] |= (uint8_t)mask[l];
             }
-            else if (chip8->inst.NN == 0xEE)
-            {   
-                // 0x00EE: Return from subroutine
-                // Set program counter to last address on subroutine stack (pop it off the stack)
-                // such that next opcode code will be taken from that address,
-                chip8->PC = *--chip8->stack_ptr;
+            break;
+
+        case OP_EXIT:
+            // 0x00FD: Exit (SCHIP); the lane stays on this instruction and is marked exited
+            if (!quirks.schip) break;
+            for (uint32_t l = 0; l < BATCH_LANES; l++)
+            {
+                batch->PC[l] -= 2 & mask[l];
+                batch->exited[l] |= mask[l] != 0;
             }
-            else
+            break;
+
+        case OP_LOW:
+        case OP_HIGH:
+            // 0x00FE/0x00FF: Switch to lo-res/hi-res and clear the screen (SCHIP)
+            if (!quirks.schip) break;
+            for (uint32_t l = 0; l < BATCH_LANES; l++)
             {
-                // unimplemented or invalid opcode
-            } 
+                batch->hires[l] = mask[l] ? opcode == 0x00FF : batch->hires[l];
+                clear_planes(batch->display[l], ((1 << batch->display_planes) - 1) & (uint8_t)mask[l], quirks);
+                batch->display_written[l] |= (uint8_t)mask[l];
+            }
             break;
 
-        case 0x01:
+        case OP_JP:
             // 0x1NNN: Jump to address NNN
-            chip8->PC = chip8->inst.NNN;
+            for (uint32_t l = 0; l < BATCH_LANES; l++) batch->PC[l] = LANE_SELECT(mask[l], NNN, batch->PC[l]);
             break;
 
-        case 0x02:
+        case OP_CALL:
             // 0x2NNN: Call subroutine at NNN
-            // Store curent address for return to subroutine stack
-            // and set program counter to subroutine address
-            // such that the next opcode is taken from there.
-            *chip8->stack_ptr++ = chip8->PC;
-            chip8->PC = chip8->inst.NNN;
+            for (uint32_t l = 0; l < BATCH_LANES; l++)
+            {
+                uint16_t *top = &batch->stack[batch->stack_ptr[l]][l];
+                const uint8_t sp = (batch->stack_ptr[l] + 1) & (STACK_DEPTH - 1);
+                *top = LANE_SELECT(mask[l], batch->PC[l], *top);
+                batch->stack_ptr[l] = LANE_SELECT((uint8_t)mask[l], sp, batch->stack_ptr[l]);
+                batch->fault[l] |= (sp == 0) * FAULT_STACK_OVERFLOW & (uint8_t)mask[l];
+                batch->PC[l] = LANE_SELECT(mask[l], NNN, batch->PC[l]);
+            }
             break;
 
-        case 0x03:
+        case OP_SE:
             // 0x3XNN: Check if VX == NN, if so, skip the next instruction
-            if(chip8->V[chip8->inst.X] == chip8->inst.NN)
-            {
-                chip8->PC += 2;                     // skip next opcode
-            }
+            batch_skip_sizes(batch, skip, quirks);
+            for (uint32_t l = 0; l < BATCH_LANES; l++) batch->PC[l] += (uint16_t)-(VX[l] == NN) & skip[l] & mask[l];
             break;
 
-        case 0x04:
+        case OP_SNE:
             // 0x4XNN: Check if VX != NN, if so, skip the next instruction
-            if(chip8->V[chip8->inst.X] != chip8->inst.NN)
+            batch_skip_sizes(batch, skip, quirks);
+            for (uint32_t l = 0; l < BATCH_LANES; l++) batch->PC[l] += (uint16_t)-(VX[l] != NN) & skip[l] & mask[l];
+            break;
+
+        case OP_SE_V:
+            // 0x5XY0: Check if VX == VY, if so, skip next instruction
+            batch_skip_sizes(batch, skip, quirks);
+            for (uint32_t l = 0; l < BATCH_LANES; l++) batch->PC[l] += (uint16_t)-(VX[l] == VY[l]) & skip[l] & mask[l];
+            break;
+
+        case OP_ST_XY:
+            // 0x5XY2: Store VX-VY inclusive to memory from I, leaving I (XO-CHIP)
+            if (!quirks.xochip) break;
+            for (uint32_t a = 0, count = batch_active_lanes(mask, lanes); a < count; a++)
             {
-                chip8->PC += 2;                     // skip next opcode
+                const uint8_t l = lanes[a];
+                const int8_t step = X <= Y ? 1 : -1;
+                for (uint8_t i = 0, r = X; ; i++, r += step)
+                {
+                    mem_write(&batch->mem[l], batch->I[l] + i, batch->V[r][l]);
+                    if (r == Y) break;
+                }
             }
             break;
 
-        case 0x05:
-            // 0x5XY0: Check if VX == VY, if so, skip next instruction
-            if (chip8->inst.N != 0) break;         // wrong opcode
-            if(chip8->V[chip8->inst.X] == chip8->V[chip8->inst.Y])
+        case OP_LD_XY:
+            // 0x5XY3: Load VX-VY inclusive from memory at I, leaving I (XO-CHIP)
+            if (!quirks.xochip) break;
+            for (uint32_t l = 0; l < BATCH_LANES; l++)
             {
-                chip8->PC += 2;                     // skip next opcode
+                const int8_t step = X <= Y ? 1 : -1;
+                for (uint8_t i = 0, r = X; ; i++, r += step)
+                {
+                    batch->V[r][l] = LANE_SELECT((uint8_t)mask[l], mem_read(&batch->mem[l], batch->I[l] + i), batch->V[r][l]);
+                    if (r == Y) break;
+                }
             }
             break;
-            
-        case 0x06:
+
+        case OP_LD:
             // 0x6XNN: Set register VX to NN
-            // V offset by X
-            chip8->V[chip8->inst.X] = chip8->inst.NN;
+            for (uint32_t l = 0; l < BATCH_LANES; l++) VX[l] = LANE_SELECT((uint8_t)mask[l], NN, VX[l]);
             break;
 
-        case 0x07:
+        case OP_ADD:
             // 0x7XNN: Set register VX += NN
-            chip8->V[chip8->inst.X] += chip8->inst.NN;
+            for (uint32_t l = 0; l < BATCH_LANES; l++) VX[l] = LANE_SELECT((uint8_t)mask[l], (uint8_t)(VX[l] + NN), VX[l]);
             break;
 
-        case 0x08:
-            switch (chip8->inst.N)
-            {
-                case 0:
-                    // 0x8XY0: Set register VX = VY
-                    chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y];
-                    break;
-
-                case 1:
-                    // 0x8XY1: Set register VX |= VY
-                    chip8->V[chip8->inst.X] |= chip8->V[chip8->inst.Y];
-                    break;
+        // the 8XYN cases mirror emulate_instruction one lane loop at a time: flags computed first,
+        // written before or after the result as the platform says, so X or Y == F alias exactly
+        // as they do in the scalar core
+        case OP_LD_V:
+            // 0x8XY0: Set register VX = VY
+            for (uint32_t l = 0; l < BATCH_LANES; l++) VX[l] = LANE_SELECT((uint8_t)mask[l], VY[l], VX[l]);
+            break;
 
-                case 2:
-                    // 0x8XY2: Set register VX &= VY
-                    chip8->V[chip8->inst.X] &= chip8->V[chip8->inst.Y];
-                    break;
+        case OP_OR:
+            // 0x8XY1: Set register VX |= VY; COSMAC VIP clears VF
+            for (uint32_t l = 0; l < BATCH_LANES; l++) VX[l] = LANE_SELECT((uint8_t)mask[l], VX[l] | VY[l], VX[l]);
+            if (quirks.vf_reset) for (uint32_t l = 0; l < BATCH_LANES; l++) VF[l] = LANE_SELECT((uint8_t)mask[l], 0, VF[l]);
+            break;
 
-                case 3:
-                    // 0x8XY3: Set register VX ^= VY
-                    chip8->V[chip8->inst.X] ^= chip8->V[chip8->inst.Y];
-                    break;
+        case OP_AND:
+            // 0x8XY2: Set register VX &= VY; COSMAC VIP clears VF
+            for (uint32_t l = 0; l < BATCH_LANES; l++) VX[l] = LANE_SELECT((uint8_t)mask[l], VX[l] & VY[l], VX[l]);
+            if (quirks.vf_reset) for (uint32_t l = 0; l < BATCH_LANES; l++) VF[l] = LANE_SELECT((uint8_t)mask[l], 0, VF[l]);
+            break;
 
-                case 4:
-                    // 0x8XY4: Set register VX += VY, set VF to 1 if carry, 0 if not
-                    if ((uint16_t)(chip8->V[chip8->inst.X] + chip8->V[chip8->inst.Y]) > 255)
-                    {
-                        chip8->V[0xF] = 1;
-                    }   
-                    chip8->V[chip8->inst.X] += chip8->V[chip8->inst.Y];
-                    break;
+        case OP_XOR:
+            // 0x8XY3: Set register VX ^= VY; COSMAC VIP clears VF
+            for (uint32_t l = 0; l < BATCH_LANES; l++) VX[l] = LANE_SELECT((uint8_t)mask[l], VX[l] ^ VY[l], VX[l]);
+            if (quirks.vf_reset) for (uint32_t l = 0; l < BATCH_LANES; l++) VF[l] = LANE_SELECT((uint8_t)mask[l], 0, VF[l]);
+            break;
 
-                case 5:
-                    // 0x8XY5: Set register VX -= VY, set VF to 1 if there is not a borrow (result is positive)
-                    chip8->V[0xF] = chip8->V[chip8->inst.Y] <= chip8->V[chip8->inst.X]; 
-                    chip8->V[chip8->inst.X] -= chip8->V[chip8->inst.Y];
-                    break;
+        case OP_ADD_V:
+            // 0x8XY4: Set register VX += VY, set VF to 1 if carry
+            for (uint32_t l = 0; l < BATCH_LANES; l++) flag[l] = (uint16_t)(VX[l] + VY[l]) > 255;
+            if (!quirks.flag_after_result) batch_set_flag(VF, flag, mask, !quirks.vf_clear_on_no_carry);
+            for (uint32_t l = 0; l < BATCH_LANES; l++) VX[l] = LANE_SELECT((uint8_t)mask[l], (uint8_t)(VX[l] + VY[l]), VX[l]);
+            if (quirks.flag_after_result) batch_set_flag(VF, flag, mask, !quirks.vf_clear_on_no_carry);
+            break;
 
-                case 6:
-                    // 0x8XY6: Set register VX >>= 1, store shifted off bit in VF
-                    chip8->V[0xF] = chip8->V[chip8->inst.X] & 1;
-                    chip8->V[chip8->inst.X] >>= 1;
-                    break;
+        case OP_SUB:
+            // 0x8XY5: Set register VX -= VY, set VF to 1 if there is not a borrow
+            for (uint32_t l = 0; l < BATCH_LANES; l++) flag[l] = VY[l] <= VX[l];
+            if (!quirks.flag_after_result) batch_set_flag(VF, flag, mask, false);
+            for (uint32_t l = 0; l < BATCH_LANES; l++) VX[l] = LANE_SELECT((uint8_t)mask[l], (uint8_t)(VX[l] - VY[l]), VX[l]);
+            if (quirks.flag_after_result) batch_set_flag(VF, flag, mask, false);
+            break;
 
-                case 7:
-                    // 0x8XY7: Set register VX = VY - VX. set VF to 1 if there is not a borrow (result is positive)
-                    chip8->V[0xF] = chip8->V[chip8->inst.X] <= chip8->V[chip8->inst.Y];
-                    chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y] - chip8->V[chip8->inst.X];
-                    break;
+        case OP_SHR:
+            // 0x8XY6: Set register VX = VY >> 1 (SCHIP: VX >>= 1), store shifted off bit in VF
+            for (uint32_t l = 0; l < BATCH_LANES; l++) flag[l] = SRC[l] & 1;
+            if (!quirks.flag_after_result) batch_set_flag(VF, flag, mask, false);
+            for (uint32_t l = 0; l < BATCH_LANES; l++) VX[l] = LANE_SELECT((uint8_t)mask[l], SRC[l] >> 1, VX[l]);
+            if (quirks.flag_after_result) batch_set_flag(VF, flag, mask, false);
+            break;
 
-                case 0xE:
-                    // 0x8XY8: Set register VX <<= 1, store shifted off bit in VF
-                    chip8->V[0xF] = (chip8->V[chip8->inst.X] & 0x80) >> 7;
-                    chip8->V[chip8->inst.X] <<= 1;
-                    break;
+        case OP_SUBN:
+            // 0x8XY7: Set register VX = VY - VX, set VF to 1 if there is not a borrow
+            for (uint32_t l = 0; l < BATCH_LANES; l++) flag[l] = VX[l] <= VY[l];
+            if (!quirks.flag_after_result) batch_set_flag(VF, flag, mask, false);
+            for (uint32_t l = 0; l < BATCH_LANES; l++) VX[l] = LANE_SELECT((uint8_t)mask[l], (uint8_t)(VY[l] - VX[l]), VX[l]);
+            if (quirks.flag_after_result) batch_set_flag(VF, flag, mask, false);
+            break;
 
-                default:
-                    // Wrong/Unimplemented opcode
-                    break;
-            }
+        case OP_SHL:
+            // 0x8XYE: Set register VX = VY << 1 (SCHIP: VX <<= 1), store shifted off bit in VF
+            for (uint32_t l = 0; l < BATCH_LANES; l++) flag[l] = SRC[l] >> 7;
+            if (!quirks.flag_after_result) batch_set_flag(VF, flag, mask, false);
+            for (uint32_t l = 0; l < BATCH_LANES; l++) VX[l] = LANE_SELECT((uint8_t)mask[l], (uint8_t)(SRC[l] << 1), VX[l]);
+            if (quirks.flag_after_result) batch_set_flag(VF, flag, mask, false);
             break;
 
-        case 0x09:
+        case OP_SNE_V:
             // 0x9XY0: Check if VX != VY; skip next instruction if so
-            if (chip8->V[chip8->inst.X] != chip8->V[chip8->inst.Y])
-            {
-                chip8->PC += 2;
-            }
+            batch_skip_sizes(batch, skip, quirks);
+            for (uint32_t l = 0; l < BATCH_LANES; l++) batch->PC[l] += (uint16_t)-(VX[l] != VY[l]) & skip[l] & mask[l];
             break;
 
-        case 0x0A:
-            // 0XANNN: Set index register I to NNN
-            chip8->I = chip8->inst.NNN;
+        case OP_LD_I:
+            // 0xANNN: Set index register I to NNN
+            for (uint32_t l = 0; l < BATCH_LANES; l++) batch->I[l] = LANE_SELECT(mask[l], NNN, batch->I[l]);
             break;
 
-        case 0x0B:
-            // 0xBNNN: Jump to V0 + NNN
-            chip8->PC = chip8->V[0] + chip8->inst.NNN;
+        case OP_JP_V0:
+            // 0xBNNN: Jump to V0 + NNN; SCHIP reads it as BXNN, jump to VX + XNN
+            for (uint32_t l = 0; l < BATCH_LANES; l++)
+            {
+                batch->PC[l] = LANE_SELECT(mask[l], batch->V[quirks.jump_vx ? X : 0][l] + NNN, batch->PC[l]);
+            }
             break;
 
-        case 0x0C:
-            // 0xCXNN: Set register VX = rand() % 256 & NN (bitwise AND)
-            chip8->V[chip8->inst.X] = (rand() % 256) & chip8->inst.NN;
+        case OP_RND:
+            // 0xCXNN: Set register VX = rand() % 256 & NN; only active lanes advance their generator
+            for (uint32_t l = 0; l < BATCH_LANES; l++)
+            {
+                uint32_t x = batch->rng[l];
+                x ^= x << 13;
+                x ^= x >> 17;
+                x ^= x << 5;
+                batch->rng[l] = LANE_SELECT((uint32_t)-(mask[l] != 0), x, batch->rng[l]);
+                VX[l] = LANE_SELECT((uint8_t)mask[l], (batch->rng[l] >> 24) & NN, VX[l]);
+            }
             break;
 
-        case 0x0D:
-            // 0xDXYN: Draw N-height sprite at coordinate X,Y
-            // Read from location memory I
-            // Screen pixels are XOR'd with sprite bits, 
-            // VF (Carry flag) is set if any screen pixels are set off; useful for collision detection
-
-            // init vars
-            uint8_t X = chip8->V[chip8->inst.X] % WINDOW_WIDTH;
-            uint8_t Y = chip8->V[chip8->inst.Y] % WINDOW_HEIGHT;
-            const uint8_t orig_X = X;
-
-             // initalize carry flag to 0
-            chip8->V[0xF] = 0;
-
-            // loop over all N rows of the sprite
-            for (uint8_t i = 0; i < chip8->inst.N; i++) 
+        case OP_DRW16:
+        case OP_DRW:
+            // 0xDXYN: Draw N-height sprite at coordinate X,Y; per lane since each has its own display
+            if (batch->defer_draws)
             {
-                // get next byte/row of sprite data
-                const uint8_t sprite_data = chip8->ram[chip8->I + i];
-                X = orig_X;                         // reset X for next row to draw
-
-                // loop thru the row
-                for (int j = 7; j >= 0; j--)
+                for (uint32_t a = 0, count = batch_active_lanes(mask, lanes); a < count; a++)
                 {
-                    // if sprite pixel/bit is on and display pixel is on, set carry flag
-                    if (sprite_data & (1 << j) && chip8->display[Y * WINDOW_WIDTH + X])
-                    {
-                        chip8->V[0xF] = 1;          // set carry flag
-                    }
+                    const uint8_t l = lanes[a];
+                    const deferred_draw_t draw = { batch->I[l], VX[l], VY[l], N, active_planes(batch->planes[l], quirks) };
+                    draw_list_append(&batch->draws[l], draw);
+                }
+                break;
+            }
+            // an inactive lane draws on no planes, which leaves its display alone
+            for (uint32_t l = 0; l < BATCH_LANES; l++)
+            {
+                batch->display_written[l] |= display_bands(VY[l], sprite_rows(N, quirks), batch->hires[l],
+                                                           quirks.wrap_sprites) & (uint8_t)mask[l];
+                const uint8_t planes = active_planes(batch->planes[l], quirks) & (uint8_t)mask[l];
+                const uint8_t collided = draw_sprite(batch->display[l], &batch->mem[l], batch->I[l], VX[l], VY[l], N,
+                                                     batch->hires[l], planes, quirks);
+                VF[l] = LANE_SELECT((uint8_t)mask[l], collided, VF[l]);
+            }
+            break;
 
-                    // XOR display pixel with sprite pixel/bit to set it on or off
-                    chip8->display[Y * WINDOW_WIDTH + X] ^= (sprite_data & (1 << j));
+        case OP_SKP:
+            // 0xEX9E: Skip next instruction if key in VX is pressed
+            batch_skip_sizes(batch, skip, quirks);
+            for (uint32_t l = 0; l < BATCH_LANES; l++)
+            {
+                batch->fault[l] |= (VX[l] > 0xF) * FAULT_BAD_KEY & (uint8_t)mask[l];
+                batch->PC[l] += (uint16_t)-(batch->keypad[l][VX[l] & 0xF] != 0) & skip[l] & mask[l];
+            }
+            break;
 
-                    // Stop drawing if right edge of screen is hit
-                    if (++X >= WINDOW_WIDTH) break;
-                }
-                
-                // Stop drawing entire sprite if bottom edge of screen is hit
-                if (++Y >= WINDOW_HEIGHT) break;
+        case OP_SKNP:
+            // 0xEXA1: Skip next instruction if key in VX is not pressed
+            batch_skip_sizes(batch, skip, quirks);
+            for (uint32_t l = 0; l < BATCH_LANES; l++)
+            {
+                batch->fault[l] |= (VX[l] > 0xF) * FAULT_BAD_KEY & (uint8_t)mask[l];
+                batch->PC[l] += (uint16_t)-(batch->keypad[l][VX[l] & 0xF] == 0) & skip[l] & mask[l];
             }
             break;
 
-        case 0x0E:
-            if (chip8->inst.NN == 0x09E)
+        case OP_LD_K:
+            // 0xFX0A: Await until a keypress, and store in VX
+            for (uint32_t l = 0; l < BATCH_LANES; l++)
             {
-                // 0xEX9E: Skip next instruction if key in VX is pressed
-                if (chip8->keypad[chip8->V[chip8->inst.X]])
-                {
-                    chip8->PC += 2;
-                }
+                // lowest pressed key, 16 for none
+                uint8_t key = 16;
+                for (int8_t i = 15; i >= 0; i--) key = batch->keypad[l][i] ? i : key;
 
+                const uint8_t pressed = (uint8_t)-(key < 16) & (uint8_t)mask[l];
+                VX[l] = LANE_SELECT(pressed, key, VX[l]);
+                batch->PC[l] -= 2 & (uint16_t)-(key == 16) & mask[l];
             }
-            else if (chip8->inst.NN == 0xA1)
+            break;
+
+        case OP_LONG:
+            // 0xF000 NNNN: Set I to the 16 bit address in the next word, and step over it (XO-CHIP)
+            if (!quirks.xochip) break;
+            for (uint32_t l = 0; l < BATCH_LANES; l++)
             {
-                // 0xEX9E: Skip next instruciton if key in VX is not pressed
-                if (!chip8->keypad[chip8->V[chip8->inst.X]])
-                {
-                    chip8->PC += 2;
-                }
+                const uint16_t NNNN = (mem_read(&batch->mem[l], batch->PC[l]) << 8) |
+                                      mem_read(&batch->mem[l], batch->PC[l] + 1);
+                batch->I[l] = LANE_SELECT(mask[l], NNNN, batch->I[l]);
+                batch->PC[l] += 2 & mask[l];
             }
             break;
-        
-        case 0x0F:
-            switch (chip8->inst.NN)
-            {
-                case 0x0A:
-                    // 0xFX0A : VX = get_key(); Await until a keypress, and store in VX
-                    bool any_key_pressed = false;
-                    for (uint8_t i = 0; i < sizeof(chip8->keypad); i++)
-                    {
-                        if (chip8->keypad[i])
-                        {   
-                            chip8->V[chip8->inst.X] = i;                // i = key (offset into keypad array)
-                            any_key_pressed = true;
-                            break;
-                        }
-                    }
 
-                    // If no key has been pressed, then keep grabbing the current opcode and run it.
-                    if (!any_key_pressed) chip8->PC -= 2;
-                    
-                    break;
+        case OP_PLANE:
+            // 0xFN01: Select the display planes that draws, clears and scrolls act on (XO-CHIP)
+            if (!quirks.xochip) break;
+            for (uint32_t l = 0; l < BATCH_LANES; l++) batch->planes[l] = LANE_SELECT((uint8_t)mask[l], X, batch->planes[l]);
+            break;
 
-                case 0x1E:
-                    // 0xFX1E: I += VX; Add VX to register I. 
-                    chip8->I += chip8->V[chip8->inst.X];
-                    break;
+        case OP_ADD_I:
+            // 0xFX1E: I += VX
+            for (uint32_t l = 0; l < BATCH_LANES; l++) batch->I[l] = LANE_SELECT(mask[l], batch->I[l] + VX[l], batch->I[l]);
+            break;
 
-                case 0x07:
-                    // 0xFX07: Set VX = delay timer
-                    chip8->V[chip8->inst.X] = chip8->delay_timer;
-                    break;
+        case OP_LD_DT:
+            // 0xFX07: Set VX = delay timer
+            for (uint32_t l = 0; l < BATCH_LANES; l++) VX[l] = LANE_SELECT((uint8_t)mask[l], batch->delay_timer[l], VX[l]);
+            break;
 
-                case 0x15:
-                    // 0xFX15: Set delay timer = VX
-                    chip8->delay_timer = chip8->V[chip8->inst.X];
-                    break;
+        case OP_SET_DT:
+            // 0xFX15: Set delay timer = VX
+            for (uint32_t l = 0; l < BATCH_LANES; l++) batch->delay_timer[l] = LANE_SELECT((uint8_t)mask[l], VX[l], batch->delay_timer[l]);
+            break;
 
-                case 0x18:
-                    // 0xFX15: Set sound timer = VX
-                    chip8->sound_timer = chip8->V[chip8->inst.X];
-                    break;
+        case OP_SET_ST:
+            // 0xFX18: Set sound timer = VX
+            for (uint32_t l = 0; l < BATCH_LANES; l++) batch->sound_timer[l] = LANE_SELECT((uint8_t)mask[l], VX[l], batch->sound_timer[l]);
+            break;
 
-                case 0x29:
-                    // 0xFX29: Set register I to sprite location in memory for character in VX (0x0 to 0xF)
-                    chip8->I = chip8->V[chip8->inst.X] * 5;
-                    break;
+        case OP_LD_F:
+            // 0xFX29: Set I to sprite location for character in VX
+            for (uint32_t l = 0; l < BATCH_LANES; l++) batch->I[l] = LANE_SELECT(mask[l], VX[l] * 5, batch->I[l]);
+            break;
 
-                case 0x33:
-                    // 0xFX33: Store BCD representation of VX at memory offset from I
-                    uint8_t bcd = chip8->V[chip8->inst.X];
-                    chip8->ram[chip8->I+2] = bcd % 10;
-                    bcd /= 10;
-                    chip8->ram[chip8->I+1] = bcd % 10;
-                    bcd /= 10;
-                    chip8->ram[chip8->I] = bcd;
-                    break;
-                
-                case 0x55:
-                    // 0xFX55: Register dump V0-VX inclusive to memory offset from I;
-                    // note: SCHIP does not increment I, CHIP8 does increment I
-                    for (uint8_t i = 0; i <= chip8->inst.X; i++)
-                    {
-                        chip8->ram[chip8->I + i] = chip8->V[i];
-                    }
-                    break;
+        case OP_LD_HF:
+            // 0xFX30: Set I to the 8x10 sprite for digit VX (SCHIP)
+            if (!quirks.schip) break;
+            for (uint32_t l = 0; l < BATCH_LANES; l++)
+            {
+                batch->I[l] = LANE_SELECT(mask[l], BIG_FONT_ADDR + (VX[l] & 0xF) * 10, batch->I[l]);
+            }
+            break;
 
-                case 0x65:
-                    // 0xFX55: Register load V0-VX inclusive to memory offset from I.
-                    // note: SCHIP does not increment I, CHIP8 does increment I
-                    for (uint8_t i = 0; i <= chip8->inst.X; i++)
-                    {
-                       chip8->V[i] = chip8->ram[chip8->I + i];
-                    }
-                    break;
+        case OP_LD_B:
+            // 0xFX33: Store BCD representation of VX at memory offset from I
+            for (uint32_t a = 0, count = batch_active_lanes(mask, lanes); a < count; a++)
+            {
+                const uint8_t l = lanes[a];
+                uint8_t bcd = VX[l];
+                mem_write(&batch->mem[l], batch->I[l]+2, bcd % 10);
+                bcd /= 10;
+                mem_write(&batch->mem[l], batch->I[l]+1, bcd % 10);
+                bcd /= 10;
+                mem_write(&batch->mem[l], batch->I[l], bcd);
+            }
+            break;
 
-                default:    
-                    // unimplemented or invalid opcode
-                    break;
+        case OP_STORE:
+            // 0xFX55: Register dump V0-VX inclusive to memory offset from I
+            for (uint32_t a = 0, count = batch_active_lanes(mask, lanes); a < count; a++)
+            {
+                const uint8_t l = lanes[a];
+                for (uint8_t i = 0; i <= X; i++) mem_write(&batch->mem[l], batch->I[l] + i, batch->V[i][l]);
+                if (quirks.load_store_inc) batch->I[l] += X + 1;
+            }
+            break;
+
+        case OP_LOAD:
+            // 0xFX65: Register load V0-VX inclusive from memory offset from I
+            for (uint32_t l = 0; l < BATCH_LANES; l++)
+            {
+                for (uint8_t i = 0; i <= X; i++)
+                {
+                    batch->V[i][l] = LANE_SELECT((uint8_t)mask[l], mem_read(&batch->mem[l], batch->I[l] + i), batch->V[i][l]);
+                }
+                if (quirks.load_store_inc) batch->I[l] += (X + 1) & mask[l];
+            }
+            break;
+
+        case OP_SAVE_R:
+            // 0xFX75: Store V0-VX inclusive in the RPL user flags (SCHIP)
+            if (!quirks.schip) break;
+            for (uint32_t l = 0; l < BATCH_LANES; l++)
+            {
+                for (uint8_t i = 0; i <= X; i++)
+                {
+                    batch->rpl[l][i] = LANE_SELECT((uint8_t)mask[l], batch->V[i][l], batch->rpl[l][i]);
+                }
+            }
+            break;
+
+        case OP_LOAD_R:
+            // 0xFX85: Load V0-VX inclusive from the RPL user flags (SCHIP)
+            if (!quirks.schip) break;
+            for (uint8_t i = 0; i <= X; i++)
+            {
+                for (uint32_t l = 0; l < BATCH_LANES; l++)
+                {
+                    batch->V[i][l] = LANE_SELECT((uint8_t)mask[l], batch->rpl[l][i], batch->V[i][l]);
+                }
             }
             break;
 
-        default:    
+        default:
             // unimplemented or invalid opcode
             break;
     }
 }
 
-void update_timers(chip8_t *chip8)
+// step every lane by one instruction. While all lanes fetch the same opcode the
+// whole batch executes it at once; on divergence each distinct opcode runs
+// masked over just the lanes that fetched it, down to one lane per group.
+static ALWAYS_INLINE void batch_emulate_instruction_impl(chip8_batch_t *batch, const chip8_quirks_t quirks)
 {
-    if (chip8->delay_timer > 0) chip8->delay_timer--;
+    uint16_t mask[BATCH_LANES];
 
-    if (chip8->sound_timer > 0)
+    // gather every lane's opcode first, then compare and pre-increment in loops with no reads
+    for (uint32_t l = 0; l < BATCH_LANES; l++)
     {
-        chip8->sound_timer--;
+        batch->opcode[l] = (mem_read(&batch->mem[l], batch->PC[l]) << 8) | mem_read(&batch->mem[l], batch->PC[l]+1);
+    }
+    bool lockstep = true;
+    for (uint32_t l = 0; l < BATCH_LANES; l++) lockstep &= batch->opcode[l] == batch->opcode[0];
+    for (uint32_t l = 0; l < BATCH_LANES; l++) batch->PC[l] += 2;
 
-        // TODO: Play sound
+    if (lockstep)
+    {
+        for (uint32_t l = 0; l < BATCH_LANES; l++) mask[l] = 0xFFFF;
+        batch_execute(batch, batch->opcode[0], mask, quirks);
+        return;
     }
-    else
+
+    // diverged: run each distinct opcode once, masked to the lanes that fetched it
+    bool done[BATCH_LANES] = {0};
+    for (uint32_t l = 0; l < BATCH_LANES; l++)
     {
-        // TODO: Stop playing sound
+        if (done[l]) continue;
+
+        const uint16_t opcode = batch->opcode[l];
+        for (uint32_t k = 0; k < BATCH_LANES; k++)
+        {
+            mask[k] = (!done[k] && batch->opcode[k] == opcode) ? 0xFFFF : 0;
+            done[k] |= mask[k] != 0;
+        }
+        batch_execute(batch, opcode, mask, quirks);
     }
 }
 
+void batch_emulate_instruction(chip8_batch_t *batch)
+{
+#define SPECIALIZE(quirks) batch_emulate_instruction_impl(batch, quirks)
+    DISPATCH_PLATFORM(batch->platform)
+#undef SPECIALIZE
+}
+
+// step every lane count times in one loop specialized for the batch's platform
+void batch_emulate_instructions(chip8_batch_t *batch, uint32_t count)
+{
+#define SPECIALIZE(quirks) for (uint32_t i = 0; i < count; i++) batch_emulate_instruction_impl(batch, quirks)
+    DISPATCH_PLATFORM(batch->platform)
+#undef SPECIALIZE
+}
+
+void batch_update_timers(chip8_batch_t *batch)
+{
+    for (uint32_t l = 0; l < BATCH_LANES; l++) batch->delay_timer[l] -= batch->delay_timer[l] > 0;
+    for (uint32_t l = 0; l < BATCH_LANES; l++) batch->sound_timer[l] -= batch->sound_timer[l] > 0;
+}
+
 // - - - - - - - - -
 // MAIN PROGRAM
 // - - - - - - - - - 
 
+// tools and libraries that #include this file define CHIP8_NO_MAIN to get just the core
+#ifndef CHIP8_NO_MAIN
+
+// one 60hz frame's instructions, under the debugger or profiler when either is in use. ROM faults
+// are latched rather than checked per instruction; each kind is reported once
+static void emulate_frame(chip8_t *chip8, debugger_t *debugger, chip8_profile_t *profile, uint8_t *reported_faults)
+{
+    // breakpoint checks only cost anything while some are armed
+    if (debugger->armed) debugger_emulate(debugger, chip8, profile, INSTRUCTS_PER_SECOND / 60);
+    else if (profile) emulate_instructions_profiled(chip8, profile, INSTRUCTS_PER_SECOND / 60);
+    else emulate_instructions(chip8, INSTRUCTS_PER_SECOND / 60);
+
+    if (chip8->fault & ~*reported_faults)
+    {
+        char faults[64];
+        describe_faults(chip8->fault & ~*reported_faults, faults, sizeof faults);
+        SDL_Log("ROM fault by PC 0x%03X: %s\n", chip8->PC, faults);
+        *reported_faults = chip8->fault;
+        if (debugger->attached) chip8->state = PAUSED;
+    }
+}
+
 int main (int argc, char **argv)
 {
     // arg handling
     // - - - - - - - -
     if (argc < 2)
     {
-        fprintf(stderr, "Usage: %s <Rom-Name>\n", argv[0]);
+        fprintf(stderr, "Usage: %s <Rom-Name> [--platform chip8|cosmac|schip|xochip] [--profile FILE.json|FILE.csv] [--flame FILE] [--stats FILE.json] [--metrics-port PORT] [--max-frame-skip N] [--vsync] [--blend] [--debug [--history-mb MB] [--history-spacing FRAMES]] [--trace FILE]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    char *platform_name = NULL;
+    char *trace_file = NULL;
+    char *profile_file = NULL;
+    char *flame_file = NULL;
+    char *stats_file = NULL;
+    uint16_t metrics_port = 0;
+    static debugger_t debugger;
+    uint32_t history_mb = 64;
+    uint32_t history_spacing = 60;
+    bool vsync = false;
+    bool blend = false;
+    for (int i = 2; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--debug")) debugger.attached = true;
+        else if (!strcmp(argv[i], "--vsync")) vsync = true;
+        else if (!strcmp(argv[i], "--blend")) vsync = blend = true;
+        else if (i + 1 >= argc) break;
+        else if (!strcmp(argv[i], "--platform")) platform_name = argv[++i];
+        else if (!strcmp(argv[i], "--trace")) trace_file = argv[++i];
+        else if (!strcmp(argv[i], "--profile")) profile_file = argv[++i];
+        else if (!strcmp(argv[i], "--flame")) flame_file = argv[++i];
+        else if (!strcmp(argv[i], "--stats")) stats_file = argv[++i];
+        else if (!strcmp(argv[i], "--metrics-port")) metrics_port = (uint16_t)strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--history-mb")) history_mb = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--history-spacing")) history_spacing = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--max-frame-skip")) MAX_FRAME_SKIP = strtoul(argv[++i], NULL, 0);
+    }
+    if (MAX_FRAME_SKIP == 0) MAX_FRAME_SKIP = 1;
+
+    // --platform NAME: quirks to run with, if the ROM's extension doesn't say; the ROM is
+    // loaded for it, so it also sets how large the ROM may be
+    chip8_platform_t platform = platform_from_rom_name(argv[1]);
+    if (platform_name && !parse_platform(platform_name, &platform))
+    {
+        SDL_Log("Unknown platform %s\n", platform_name);
         exit(EXIT_FAILURE);
     }
 
-    (void)argc;
+#ifdef DEBUG
+    // --trace FILE: record every instruction from the start; F1 toggles recording
+    if (trace_file && !trace_open(trace_file, true)) exit(EXIT_FAILURE);
+#else
+    if (trace_file) fprintf(stderr, "--trace needs the debug build\n");
+#endif
+
+    // --profile FILE: count executions per address, report on exit
+    // --flame FILE: collapsed call stacks for flamegraph tools
+    chip8_profile_t *profile = profile_file || flame_file ? calloc(1, sizeof *profile) : NULL;
+
+    // frame timings are always recorded; --stats FILE prints them each second and dumps JSON on exit
+    static metrics_t metrics;
+
+    // --metrics-port PORT: Prometheus text metrics on http://127.0.0.1:PORT/metrics
+#ifdef CHIP8_METRICS_HTTP
+    static metrics_server_t metrics_server;
+    if (metrics_port && !metrics_server_start(&metrics_server, &metrics.live, metrics_port)) exit(EXIT_FAILURE);
+#else
+    if (metrics_port) fprintf(stderr, "--metrics-port needs the metrics build\n");
+#endif
 
     // initialization
     // - - - - - - - -
@@ -900,52 +4644,153 @@ int main (int argc, char **argv)
     SDL_Renderer *renderer = 0;
 
     // setup
-    if (!init_sdl(&window, &renderer)) exit(EXIT_FAILURE);
+    if (!init_sdl(&window, &renderer, vsync)) exit(EXIT_FAILURE);
     chip8_t chip8 = {0};
-    if (!init_chip8(&chip8, argv[1])) exit(EXIT_FAILURE);
+    if (!init_chip8(&chip8, argv[1], platform)) exit(EXIT_FAILURE);
 
     // clear screen
     clear_screen(renderer);
 
     // seed the random num gen
-    srand(time(NULL));
+    chip8.rng = (uint32_t)time(NULL) | 1;
+
+    // --debug: start paused at the console prompt; Space breaks back into it later.
+    // The run is recorded for stepping backwards: a checkpoint every --history-spacing
+    // frames, as many as fit in --history-mb, plus all input in between
+    static history_t history;
+    if (debugger.attached && history_mb && history_init(&history, (size_t)history_mb << 20, history_spacing,
+                                                        chip8.mem.mask + 1))
+    {
+        debugger.history = &history;
+    }
+    if (debugger.attached)
+    {
+        chip8.state = PAUSED;
+        puts("==== DEBUGGER: ? for commands ====");
+    }
+
+    // frames keep to a fixed 60hz schedule, so drawing time is made up for rather than added on;
+    // when it can't be, frame_skip lets frames go undrawn. Falling further behind than
+    // FRAME_LAG_MAX frames (a slow host, a pause) starts the schedule over from now
+    frame_skip_t frame_skip = { .every = 1 };
+    const uint64_t frame_ticks = SDL_GetPerformanceFrequency() / 60;
+    uint64_t deadline = 0;
+
+    // --vsync / --blend: presents follow the display's refresh instead, see display_pacer_t
+    display_pacer_t pacer;
+    SDL_RendererInfo renderer_info;
+    if (vsync && (SDL_GetRendererInfo(renderer, &renderer_info) != 0 || !(renderer_info.flags & SDL_RENDERER_PRESENTVSYNC)))
+    {
+        SDL_Log("The renderer has no vsync, keeping the 60hz schedule\n");
+        vsync = false;
+    }
+    if (vsync) pacer_init(&pacer, window, blend);
 
     // main emulator loop
     // - - - - - - - -
+    uint8_t reported_faults = 0;
     while (chip8.state != QUIT)
     {
         // handle input
         handle_input(&chip8);
+        atomic_store_explicit(&metrics.live.state, chip8.state, memory_order_relaxed);
 
-        if (chip8.state == PAUSED) continue;
-
-        // get time before running instructions
-        const uint64_t start = SDL_GetPerformanceCounter();
+        if (chip8.state == PAUSED)
+        {
+            if (debugger.attached)
+            {
+                debugger_command(&debugger, &chip8);
+                update_screen(renderer, chip8);
+                SDL_RenderPresent(renderer);
+            }
+            continue;
+        }
 
-        // emulate CHIP8 insturctions for this emulator frame (60hz)
-        for (uint32_t i = 0; i < INSTRUCTS_PER_SECOND / 60; i++)
+        if (vsync)
         {
-            emulate_instruction(&chip8);
+            // run every frame the emulator's clock completes by the coming refresh, then present
+            // for it; all but the last go unseen unless blended
+            uint64_t start = 0, end = 0;
+            uint32_t ran = 0;
+            while (chip8.state == RUNNING && pacer_frame_due(&pacer))
+            {
+                if (ran++) metrics_frame(&metrics, INSTRUCTS_PER_SECOND / 60, start, end, 0, end, false, end, end, 1);
+                if (debugger.history) history_frame(debugger.history, &chip8);
+                start = SDL_GetPerformanceCounter();
+                emulate_frame(&chip8, &debugger, profile, &reported_faults);
+                end = SDL_GetPerformanceCounter();
+
+                update_timers(&chip8);
+                if (debugger.history) history_timer(debugger.history, &chip8);
+                pacer_frame_done(&pacer, renderer, &chip8);
+            }
+
+            uint64_t rendered, presented;
+            const uint64_t shown = pacer_present(&pacer, renderer, &rendered, &presented);
+            if (ran) metrics_frame(&metrics, INSTRUCTS_PER_SECOND / 60, start, end, 0, end, true, rendered, presented, ran);
+            metrics_pacing(&metrics, presented, chip8.state == RUNNING ? shown : 0);
+            metrics_periodic(&metrics, window, stats_file != NULL);
+            continue;
         }
-        // get time elapsed after running instructions
+
+        if (debugger.history) history_frame(debugger.history, &chip8);
+
+        // emulate CHIP8 insturctions for this emulator frame (60hz), timed
+        const uint64_t start = SDL_GetPerformanceCounter();
+        emulate_frame(&chip8, &debugger, profile, &reported_faults);
         const uint64_t end = SDL_GetPerformanceCounter();
 
-        const double time_elapsed = (double)((end - start) * 1000) / SDL_GetPerformanceFrequency();
+        const bool shown = frame_skip_emulated(&frame_skip, end - start);
 
-        // delay for approx. 60hz/60fps (16.67ms)
-        SDL_Delay(16.67f > time_elapsed ? 16.67 - time_elapsed : 0);
+        // delay until this frame's slot in the 60hz schedule (16.67ms apart)
+        deadline = deadline && end < deadline + FRAME_LAG_MAX * frame_ticks ? deadline + frame_ticks : start + frame_ticks;
+        const double delay = end < deadline ? (double)((deadline - end) * 1000) / SDL_GetPerformanceFrequency() : 0;
+        SDL_Delay(delay);
+        const uint64_t woke = SDL_GetPerformanceCounter();
 
         // update window with changes
-        update_screen(renderer, chip8);
+        uint64_t rendered = woke, presented = woke;
+        if (shown)
+        {
+            update_screen(renderer, chip8);
+            rendered = SDL_GetPerformanceCounter();
+            SDL_RenderPresent(renderer);
+            presented = SDL_GetPerformanceCounter();
+            frame_skip_presented(&frame_skip, presented - woke);
+            metrics_pacing(&metrics, presented, deadline);
+        }
+
+        metrics_frame(&metrics, INSTRUCTS_PER_SECOND / 60, start, end, (uint32_t)delay, woke, shown, rendered, presented,
+                      frame_skip.every);
+        metrics_periodic(&metrics, window, stats_file != NULL);
 
         // update delay and sound timers
         update_timers(&chip8);
+        if (debugger.history) history_timer(debugger.history, &chip8);
     }
 
     // cleanup
     // - - - - - - - -
+#ifdef DEBUG
+    trace_close();
+#endif
+    atomic_store(&metrics.live.state, QUIT);
+#ifdef CHIP8_METRICS_HTTP
+    metrics_server_stop(&metrics_server);
+#endif
+    if (stats_file) metrics_write_json(&metrics, stats_file);
+    if (profile)
+    {
+        profile_report(profile, &chip8, stdout, 20);
+        if (profile_file) profile_write(profile, &chip8, profile_file);
+        if (flame_file) profile_write_collapsed(profile, flame_file);
+        free(profile);
+    }
+    if (debugger.history) history_free(debugger.history);
+    free_chip8(&chip8);
     final_sdl_cleanup(window, renderer);
 
     // exit the program
     exit(EXIT_SUCCESS);
-}
\ No newline at end of file
+}
+#endif
@@ -0,0 +1,297 @@
+// - - - - - - - - - - - - -
+//   CHIP-8 BENCHMARK SUITE
+// - - - - - - - - - - - - -
+// Three parts, all headless, results as JSON so backends and layouts can be compared
+// on the same machine:
+//   1. per-opcode microbenchmarks: a ROM that runs one opcode class in a long straight
+//      line, looping back with a single jump
+//   2. synthetic stress ROMs mixing opcodes the way games do
+//   3. whole-ROM runs of any ROM files given on the command line
+// Every benchmark runs on the scalar core and on the SoA batch core (per-instance rate).
+//
+// usage: chip8_bench [--iters N] [--frames F] [--json out.json] [--backend scalar|batch] [rom...]
+
+#define CHIP8_NO_MAIN
+#include "chip8.c"
+
+#define BODY_REPEAT 64                    // straight-line copies of the benchmarked opcode
+
+// one microbenchmark: setup opcodes run once, body opcodes repeat in the timed loop
+typedef struct {
+    const char *name;
+    uint16_t setup[8];
+    uint16_t body[4];                     // zero terminated
+} microbench_t;
+
+static const microbench_t microbenches[] = {
+    { "00E0 clear",            { 0 },                              { 0x00E0 } },
+    { "2NNN+00EE call/return", { 0 },                              { 0x2F00 } },  // 0xF00 holds 00EE
+    { "3XNN skip taken",       { 0x6007 },                         { 0x3007, 0x3007 } },
+    { "4XNN skip not taken",   { 0x6007 },                         { 0x4007 } },
+    { "6XNN load",             { 0 },                              { 0x6312 } },
+    { "7XNN add",              { 0 },                              { 0x7301 } },
+    { "8XY0 move",             { 0x6105 },                         { 0x8210 } },
+    { "8XY2 and",              { 0x6105, 0x62FF },                 { 0x8212 } },
+    { "8XY4 add carry",        { 0x61F3 },                         { 0x8214 } },
+    { "8XY5 sub borrow",       { 0x6107 },                         { 0x8215 } },
+    { "8XY6 shift right",      { 0x62AA },                         { 0x8216 } },
+    { "8XYE shift left",       { 0x62AA },                         { 0x821E } },
+    { "ANNN load I",           { 0 },                              { 0xA123 } },
+    { "CXNN random",           { 0 },                              { 0xC3FF } },
+    { "DXY1 aligned",          { 0x6000, 0x6100, 0xA000 },         { 0xD011 } },
+    { "DXY5 aligned",          { 0x6000, 0x6100, 0xA000 },         { 0xD015 } },
+    { "DXYF aligned",          { 0x6000, 0x6100, 0xA000 },         { 0xD01F } },
+    { "DXY5 unaligned X=3",    { 0x6003, 0x6100, 0xA000 },         { 0xD015 } },
+    { "DXYF unaligned X=3",    { 0x6003, 0x6100, 0xA000 },         { 0xD01F } },
+    { "DXYF clipped X=60",     { 0x603C, 0x6114, 0xA000 },         { 0xD01F } },
+    { "EX9E key check",        { 0 },                              { 0xE39E } },
+    { "FX1E add I",            { 0x6301, 0xA000 },                 { 0xF31E } },
+    { "FX29 font",             { 0x6307 },                         { 0xF329 } },
+    { "FX33 BCD",              { 0x63FE, 0xA800 },                 { 0xF333 } },
+    { "FX55 X=F store",        { 0xA800 },                         { 0xFF55 } },
+    { "FX65 X=F load",         { 0xA800 },                         { 0xFF65 } },
+};
+
+// synthetic stress ROMs, assembled as opcode lists loaded at 0x200
+typedef struct {
+    const char *name;
+    uint16_t code[32];
+    uint8_t length;
+} stress_rom_t;
+
+static const stress_rom_t stress_roms[] = {
+    // sprite storm: walk a 15 row sprite across the screen, XORing as it goes
+    { "sprite storm", {
+        0xA000, 0x6000, 0x6100,           // I = font, V0 = X, V1 = Y
+        0xD01F, 0x7003, 0x7105, 0xD01F,   // draw, move, draw
+        0xC20F, 0xF229, 0xD015,           // random digit
+        0x1206 }, 11 },
+    // alu churn: dependent arithmetic with flags
+    { "alu churn", {
+        0x6001, 0x6103, 0x6207,
+        0x8014, 0x8125, 0x8206, 0x801E, 0x8213, 0x7011, 0x8107, 0x8231, 0x8302,
+        0x3300, 0x7401, 0x9010, 0x7501,
+        0x1206 }, 17 },
+    // call chain: subroutines nested 8 deep, each level at 0x206 + 4 * depth
+    { "call chain", {
+        0x2206, 0x1200, 0x0000,
+        0x220A, 0x00EE, 0x220E, 0x00EE, 0x2212, 0x00EE, 0x2216, 0x00EE,
+        0x221A, 0x00EE, 0x221E, 0x00EE, 0x2222, 0x00EE, 0x2226, 0x00EE,
+        0x7001, 0x00EE }, 21 },
+    // memory: BCD, register dumps and loads with I walking 16 bytes at a time through 0x400-0x50F
+    { "memory", {
+        0x6600, 0xA400,
+        0xF633, 0xF565, 0xFF55, 0x6310, 0xF31E, 0x7601, 0x3610, 0x1204,
+        0x1200 }, 11 },
+};
+
+// - - - - - - - - -
+// HELPER METHODS
+// - - - - - - - - -
+
+static double seconds_since(uint64_t start)
+{
+    return (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+}
+
+static uint32_t put_opcode(uint8_t *rom, uint32_t at, uint16_t opcode)
+{
+    rom[at] = opcode >> 8;
+    rom[at + 1] = opcode & 0xFF;
+    return at + 2;
+}
+
+// assemble a microbenchmark: setup, then the body repeated, then a jump back to the body
+static size_t build_microbench(const microbench_t *mb, uint8_t *rom)
+{
+    uint32_t at = 0;
+    for (uint32_t i = 0; i < 8 && mb->setup[i]; i++) at = put_opcode(rom, at, mb->setup[i]);
+
+    const uint16_t loop = 0x200 + at;
+    for (uint32_t r = 0; r < BODY_REPEAT; r++)
+    {
+        for (uint32_t i = 0; i < 4 && mb->body[i]; i++) at = put_opcode(rom, at, mb->body[i]);
+    }
+    at = put_opcode(rom, at, 0x1000 | loop);
+
+    put_opcode(rom, 0xF00 - 0x200, 0x00EE);     // return target for the call benchmark
+    return 0xF00 - 0x200 + 2;
+}
+
+static size_t build_stress_rom(const stress_rom_t *sr, uint8_t *rom)
+{
+    uint32_t at = 0;
+    for (uint32_t i = 0; i < sr->length; i++) at = put_opcode(rom, at, sr->code[i]);
+    return at;
+}
+
+// - - - - - - - - -
+// BACKENDS
+// - - - - - - - - -
+
+// run frames on the scalar core; returns seconds
+static double run_scalar(const chip8_image_t *image, uint64_t frames, uint32_t per_frame)
+{
+    chip8_t chip8 = {0};
+    init_chip8_shared(&chip8, image, "bench");
+
+    const uint64_t start = SDL_GetPerformanceCounter();
+    for (uint64_t f = 0; f < frames; f++)
+    {
+        emulate_instructions(&chip8, per_frame);
+        update_timers(&chip8);
+    }
+    const double elapsed = seconds_since(start);
+
+    free_chip8(&chip8);
+    return elapsed;
+}
+
+// run frames on every lane of the batch core; returns seconds (for all lanes together)
+static double run_batch(const chip8_image_t *image, uint64_t frames, uint32_t per_frame)
+{
+    chip8_batch_t *batch = calloc(1, sizeof *batch);
+    init_chip8_batch(batch, image, "bench");
+
+    const uint64_t start = SDL_GetPerformanceCounter();
+    for (uint64_t f = 0; f < frames; f++)
+    {
+        batch_emulate_instructions(batch, per_frame);
+        batch_update_timers(batch);
+    }
+    const double elapsed = seconds_since(start);
+
+    free_chip8_batch(batch);
+    free(batch);
+    return elapsed;
+}
+
+// - - - - - - - - -
+// RESULTS
+// - - - - - - - - -
+
+typedef struct {
+    FILE *out;
+    bool first;
+    bool scalar;
+    bool batch;
+} report_t;
+
+static void report(report_t *r, const char *suite, const char *name, const char *backend,
+                   uint64_t instructions, uint32_t per_frame, double seconds)
+{
+    const double mips = instructions / seconds / 1e6;
+    const double ns = seconds * 1e9 / instructions;
+    const double fps = (double)instructions / per_frame / seconds;
+
+    fprintf(r->out, "%s\n    {\"suite\": \"%s\", \"name\": \"", r->first ? "" : ",", suite);
+    for (const char *c = name; *c; c++)
+    {
+        // ROM paths may contain backslashes
+        if (*c == '\\' || *c == '"') fputc('\\', r->out);
+        fputc(*c, r->out);
+    }
+    fprintf(r->out, "\", \"backend\": \"%s\", \"instructions\": %llu, \"seconds\": %.6f, \"mips\": %.3f, "
+                    "\"ns_per_instruction\": %.3f, \"frames_per_second\": %.1f}",
+            backend, (unsigned long long)instructions, seconds, mips, ns, fps);
+    r->first = false;
+
+    fprintf(stderr, "%-10s %-26s %-7s %9.2f MIPS %8.2f ns/inst\n", suite, name, backend, mips, ns);
+}
+
+static void bench_image(report_t *r, const char *suite, const char *name, const chip8_image_t *image,
+                        uint64_t instructions, uint32_t per_frame)
+{
+    const uint64_t frames = (instructions + per_frame - 1) / per_frame;
+
+    if (r->scalar)
+    {
+        report(r, suite, name, "scalar", frames * per_frame, per_frame, run_scalar(image, frames, per_frame));
+    }
+    if (r->batch)
+    {
+        // per-instance numbers: the batch runs the same total instruction count spread over its lanes
+        const uint64_t lane_frames = (frames + BATCH_LANES - 1) / BATCH_LANES;
+        const double seconds = run_batch(image, lane_frames, per_frame);
+        report(r, suite, name, "batch", lane_frames * per_frame * BATCH_LANES, per_frame, seconds);
+    }
+}
+
+// - - - - - - - - -
+// MAIN PROGRAM
+// - - - - - - - - -
+
+int main(int argc, char **argv)
+{
+    uint64_t iters = 5000000;             // instructions per micro/stress benchmark
+    uint32_t frames = 60 * 60;            // frames per whole-ROM benchmark
+    char *json_path = NULL;
+    report_t r = { .out = stdout, .first = true, .scalar = true, .batch = true };
+
+    int first_rom = argc;
+    for (int i = 1; i < argc; i++)
+    {
+        const bool has_val = i + 1 < argc;
+        if (!strcmp(argv[i], "--iters") && has_val) iters = strtoull(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--frames") && has_val) frames = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--json") && has_val) json_path = argv[++i];
+        else if (!strcmp(argv[i], "--backend") && has_val)
+        {
+            i++;
+            r.scalar = !strcmp(argv[i], "scalar");
+            r.batch = !strcmp(argv[i], "batch");
+        }
+        else
+        {
+            first_rom = i;
+            break;
+        }
+    }
+
+    if (json_path && !(r.out = fopen(json_path, "w")))
+    {
+        fprintf(stderr, "Could not open %s\n", json_path);
+        exit(EXIT_FAILURE);
+    }
+
+    const uint32_t per_frame = INSTRUCTS_PER_SECOND / 60;
+    static chip8_image_t image;
+    static uint8_t rom[RAM_SIZE];
+
+    fprintf(r.out, "{\n  \"compiler\": \"%s\",\n  \"batch_lanes\": %d,\n  \"instructs_per_frame\": %u,\n  \"results\": [",
+#ifdef __VERSION__
+            __VERSION__,
+#else
+            "unknown",
+#endif
+            BATCH_LANES, per_frame);
+
+    // 1. per-opcode microbenchmarks
+    for (size_t i = 0; i < sizeof microbenches / sizeof microbenches[0]; i++)
+    {
+        memset(rom, 0, sizeof rom);
+        const size_t size = build_microbench(&microbenches[i], rom);
+        load_chip8_image_buffer(&image, rom, size, PLATFORM_CHIP8);
+        bench_image(&r, "opcode", microbenches[i].name, &image, iters, per_frame);
+    }
+
+    // 2. synthetic stress ROMs
+    for (size_t i = 0; i < sizeof stress_roms / sizeof stress_roms[0]; i++)
+    {
+        memset(rom, 0, sizeof rom);
+        const size_t size = build_stress_rom(&stress_roms[i], rom);
+        load_chip8_image_buffer(&image, rom, size, PLATFORM_CHIP8);
+        bench_image(&r, "stress", stress_roms[i].name, &image, iters, per_frame);
+    }
+
+    // 3. whole ROMs; every backend runs its machines as "bench", so as CHIP8
+    for (int i = first_rom; i < argc; i++)
+    {
+        if (!load_chip8_image(&image, argv[i], PLATFORM_CHIP8)) continue;
+        bench_image(&r, "rom", argv[i], &image, (uint64_t)frames * per_frame, per_frame);
+    }
+
+    fprintf(r.out, "\n  ]\n}\n");
+    if (r.out != stdout) fclose(r.out);
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,356 @@
+// - - - - - - - - - - - - - - - - -
+//   CHIP-8 DIFFERENTIAL TESTER
+// - - - - - - - - - - - - - - - - -
+// Runs two cores in lockstep on the same ROM and keypad movie and compares incremental
+// state hashes every N instructions. On a mismatch both cores go back to the last
+// matching point and a binary search finds the first instruction after which they
+// disagree; the instruction and the state fields that differ are printed.
+//
+// cores: reference (emulate_instructions), profiled (emulate_instructions_profiled),
+//        batch (lane 0 of the SoA batch core, every lane fed the same input),
+//        deferred (batch, with DXYN recorded and drawn only when needed)
+//
+// movie format: one "<frame> <hex keymask>" per line; keys are held from that frame on
+//
+// usage: chip8_difftest <Rom-Name> [--a CORE] [--b CORE] [--frames F] [--every N]
+//                       [--movie FILE] [--random-keys SEED]
+
+#define CHIP8_NO_MAIN
+#include "chip8.c"
+
+typedef enum {
+    CORE_REFERENCE,
+    CORE_PROFILED,
+    CORE_BATCH,
+    CORE_DEFERRED,
+} core_kind_t;
+
+static const char *core_names[] = { "reference", "profiled", "batch", "deferred" };
+
+// one core under test; only the members its kind uses are set up
+typedef struct {
+    core_kind_t kind;
+    chip8_t chip8;                        // reference, profiled
+    chip8_profile_t *profile;             // profiled
+    chip8_batch_t *batch;                 // batch, deferred
+    hash_cache_t cache;
+} core_t;
+
+// - - - - - - - - -
+// CORES
+// - - - - - - - - -
+
+static void core_init(core_t *core, core_kind_t kind, const chip8_image_t *image, char *rom_name)
+{
+    core->kind = kind;
+    init_chip8_shared(&core->chip8, image, rom_name);
+    if (kind == CORE_PROFILED) core->profile = calloc(1, sizeof *core->profile);
+    if (kind == CORE_BATCH || kind == CORE_DEFERRED)
+    {
+        core->batch = calloc(1, sizeof *core->batch);
+        init_chip8_batch(core->batch, image, rom_name);
+        core->batch->defer_draws = kind == CORE_DEFERRED;
+    }
+}
+
+static void core_free(core_t *core)
+{
+    free_chip8(&core->chip8);
+    free(core->profile);
+    if (core->batch) free_chip8_batch(core->batch);
+    free(core->batch);
+}
+
+static void core_keys(core_t *core, uint16_t keys)
+{
+    if (!core->batch)
+    {
+        apply_keys(&core->chip8, keys);
+        return;
+    }
+    for (uint32_t l = 0; l < BATCH_LANES; l++)
+    {
+        for (uint8_t k = 0; k < 16; k++) core->batch->keypad[l][k] = (keys >> k) & 1;
+    }
+}
+
+static void core_emulate(core_t *core, uint32_t count)
+{
+    switch (core->kind)
+    {
+        case CORE_REFERENCE: emulate_instructions(&core->chip8, count); break;
+        case CORE_PROFILED: emulate_instructions_profiled(&core->chip8, core->profile, count); break;
+        case CORE_BATCH:
+        case CORE_DEFERRED: batch_emulate_instructions(core->batch, count); break;
+    }
+}
+
+static void core_timers(core_t *core)
+{
+    if (core->batch) batch_update_timers(core->batch);
+    else update_timers(&core->chip8);
+}
+
+static uint64_t core_hash(core_t *core)
+{
+    if (core->batch) return hash_batch_lane_incremental(core->batch, 0, &core->cache);
+    return hash_chip8_incremental(&core->chip8, &core->cache);
+}
+
+// copy the core's state out into a machine; release it with free_chip8
+static void core_get(core_t *core, chip8_t *out)
+{
+    if (core->batch)
+    {
+        *out = core->chip8;               // rom name etc.
+        batch_get_lane(core->batch, 0, out);
+        return;
+    }
+    *out = core->chip8;
+    out->own_image = NULL;
+    mem_clone(&out->mem, &core->chip8.mem);
+    out->display = NULL;
+    display_resize(&out->display, &out->display_planes, &out->display_full, core->chip8.display_planes,
+                   core->chip8.display_full);
+    memcpy(out->display, core->chip8.display, display_bytes(out->display_planes, out->display_full));
+}
+
+static void core_save(core_t *core, chip8_checkpoint_t *cp)
+{
+    chip8_t state;
+    core_get(core, &state);
+    checkpoint_chip8(&state, cp);
+    cp->owner = NULL;                     // state is temporary; never restore incrementally
+    free_chip8(&state);
+}
+
+static void core_restore(core_t *core, const chip8_checkpoint_t *cp)
+{
+    if (core->batch)
+    {
+        chip8_t state = {0};
+        init_chip8_shared(&state, core->chip8.mem.image, core->chip8.rom_name);
+        restore_chip8(&state, cp);
+        for (uint32_t l = 0; l < BATCH_LANES; l++) batch_set_lane(core->batch, l, &state);
+        free_chip8(&state);
+    }
+    else restore_chip8(&core->chip8, cp);
+    core->cache.valid = false;
+}
+
+// - - - - - - - - -
+// LOCKSTEP
+// - - - - - - - - -
+
+typedef struct {
+    uint16_t *keys;                       // keypad mask per frame
+    uint32_t frames;
+    uint32_t per_frame;                   // instructions per 60hz frame
+} movie_t;
+
+// run instructions [from, to) of the movie: keys change at frame starts, timers tick at frame ends
+static void core_run(core_t *core, const movie_t *movie, uint64_t from, uint64_t to)
+{
+    for (uint64_t t = from; t < to;)
+    {
+        if (t % movie->per_frame == 0) core_keys(core, movie->keys[t / movie->per_frame]);
+
+        // to the end of this frame or of the span, whichever comes first
+        const uint64_t frame_end = (t / movie->per_frame + 1) * movie->per_frame;
+        const uint64_t end = frame_end < to ? frame_end : to;
+        core_emulate(core, (uint32_t)(end - t));
+        t = end;
+
+        if (t % movie->per_frame == 0) core_timers(core);
+    }
+}
+
+// print what differs between the two cores' states
+static void print_diff(core_t *a, core_t *b)
+{
+    chip8_t sa, sb;
+    core_get(a, &sa);
+    core_get(b, &sb);
+
+    if (sa.PC != sb.PC) printf("  PC: 0x%03X vs 0x%03X\n", sa.PC, sb.PC);
+    if (sa.I != sb.I) printf("  I: 0x%03X vs 0x%03X\n", sa.I, sb.I);
+    for (uint8_t i = 0; i < 16; i++)
+    {
+        if (sa.V[i] != sb.V[i]) printf("  V%X: 0x%02X vs 0x%02X\n", i, sa.V[i], sb.V[i]);
+    }
+    const long depth_a = sa.stack_ptr, depth_b = sb.stack_ptr;
+    if (depth_a != depth_b) printf("  stack depth: %ld vs %ld\n", depth_a, depth_b);
+    for (long i = 0; i < depth_a && i < depth_b; i++)
+    {
+        if (sa.stack[i] != sb.stack[i]) printf("  stack[%ld]: 0x%03X vs 0x%03X\n", i, sa.stack[i], sb.stack[i]);
+    }
+    if (sa.delay_timer != sb.delay_timer) printf("  delay timer: %u vs %u\n", sa.delay_timer, sb.delay_timer);
+    if (sa.sound_timer != sb.sound_timer) printf("  sound timer: %u vs %u\n", sa.sound_timer, sb.sound_timer);
+    if (sa.rng != sb.rng) printf("  rng: 0x%08X vs 0x%08X\n", sa.rng, sb.rng);
+    if (sa.fault != sb.fault) printf("  faults: 0x%X vs 0x%X\n", sa.fault, sb.fault);
+
+    uint32_t shown = 0;
+    for (uint32_t addr = 0; addr <= sa.mem.mask; addr++)
+    {
+        const uint8_t va = mem_read(&sa.mem, addr), vb = mem_read(&sb.mem, addr);
+        if (va != vb && shown++ < 16) printf("  ram[0x%03X]: 0x%02X vs 0x%02X\n", addr, va, vb);
+    }
+    for (uint8_t i = 0; i < RPL_FLAGS; i++)
+    {
+        if (sa.rpl[i] != sb.rpl[i]) printf("  rpl[%u]: 0x%02X vs 0x%02X\n", i, sa.rpl[i], sb.rpl[i]);
+    }
+    if (sa.hires != sb.hires) printf("  resolution: %s vs %s\n", sa.hires ? "hi-res" : "lo-res", sb.hires ? "hi-res" : "lo-res");
+    if (sa.planes != sb.planes) printf("  planes: 0x%X vs 0x%X\n", sa.planes, sb.planes);
+    uint32_t pixels = 0;
+    const bool full = sa.display_full && sb.display_full;
+    for (uint32_t y = 0; y < (full ? DISPLAY_HEIGHT : DISPLAY_HEIGHT / 2); y++)
+    {
+        // a pixel differs if any of its plane bits do
+        display_row_t diff = { 0, 0 };
+        for (uint32_t p = 0; p < sa.display_planes && p < sb.display_planes; p++)
+        {
+            diff = row_or(diff, row_xor(row_get(sa.display, p, y, full), row_get(sb.display, p, y, full)));
+        }
+        for (uint64_t w = diff.hi; w; w &= w - 1) pixels++;
+        for (uint64_t w = diff.lo; w; w &= w - 1) pixels++;
+    }
+    if (pixels) printf("  display: %u pixels differ\n", pixels);
+
+    free_chip8(&sa);
+    free_chip8(&sb);
+}
+
+// - - - - - - - - -
+// MAIN PROGRAM
+// - - - - - - - - -
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <Rom-Name> [--a CORE] [--b CORE] [--frames F] [--every N] "
+                        "[--movie FILE] [--random-keys SEED]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    core_kind_t kind_a = CORE_REFERENCE, kind_b = CORE_BATCH;
+    uint32_t frames = 3600;
+    uint64_t every = 1000;
+    char *movie_file = NULL;
+    uint32_t seed = 0;
+
+    for (int i = 2; i < argc; i++)
+    {
+        const bool has_val = i + 1 < argc;
+        bool known = true;
+        if ((!strcmp(argv[i], "--a") || !strcmp(argv[i], "--b")) && has_val)
+        {
+            core_kind_t *kind = argv[i][2] == 'a' ? &kind_a : &kind_b;
+            known = false;
+            for (core_kind_t k = CORE_REFERENCE; k <= CORE_DEFERRED; k++)
+            {
+                if (!strcmp(argv[i + 1], core_names[k])) *kind = k, known = true;
+            }
+            i++;
+        }
+        else if (!strcmp(argv[i], "--frames") && has_val) frames = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--every") && has_val) every = strtoull(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--movie") && has_val) movie_file = argv[++i];
+        else if (!strcmp(argv[i], "--random-keys") && has_val) seed = strtoul(argv[++i], NULL, 0) | 1;
+        else known = false;
+
+        if (!known)
+        {
+            fprintf(stderr, "Unknown or incomplete option %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (every == 0) every = 1;
+
+    static chip8_image_t image;
+    if (!load_chip8_image(&image, argv[1], platform_from_rom_name(argv[1]))) exit(EXIT_FAILURE);
+
+    movie_t movie = { .frames = frames ? frames : 1, .per_frame = INSTRUCTS_PER_SECOND / 60 };
+    movie.keys = calloc(movie.frames, sizeof *movie.keys);
+    if (movie_file && !load_movie(movie_file, movie.keys, movie.frames)) exit(EXIT_FAILURE);
+    if (seed)
+    {
+        // random presses of a few keys, changing every 10 frames
+        for (uint32_t f = 0; f < movie.frames; f++)
+        {
+            if (f % 10 == 0) chip8_rand(&seed);
+            movie.keys[f] = (uint16_t)(seed & (seed >> 16));
+        }
+    }
+
+    static core_t a, b;
+    core_init(&a, kind_a, &image, argv[1]);
+    core_init(&b, kind_b, &image, argv[1]);
+
+    static chip8_checkpoint_t cp_a, cp_b;   // both cores at the last matching compare
+    core_save(&a, &cp_a);
+    core_save(&b, &cp_b);
+
+    const uint64_t total = (uint64_t)movie.frames * movie.per_frame;
+    uint64_t matched = 0;
+    bool diverged = core_hash(&a) != core_hash(&b);
+
+    printf("%s vs %s: %llu instructions, compared every %llu\n", core_names[kind_a], core_names[kind_b],
+           (unsigned long long)total, (unsigned long long)every);
+
+    while (!diverged && matched < total)
+    {
+        const uint64_t next = matched + every < total ? matched + every : total;
+        core_run(&a, &movie, matched, next);
+        core_run(&b, &movie, matched, next);
+
+        if (core_hash(&a) != core_hash(&b))
+        {
+            // binary search (matched, next] for the first instruction after which the states differ
+            uint64_t lo = matched, hi = next;
+            while (hi - lo > 1)
+            {
+                const uint64_t mid = lo + (hi - lo) / 2;
+                core_restore(&a, &cp_a);
+                core_restore(&b, &cp_b);
+                core_run(&a, &movie, matched, mid);
+                core_run(&b, &movie, matched, mid);
+                if (core_hash(&a) == core_hash(&b)) lo = mid;
+                else hi = mid;
+            }
+
+            // replay up to the last agreeing instruction, show it, then run it
+            core_restore(&a, &cp_a);
+            core_restore(&b, &cp_b);
+            core_run(&a, &movie, matched, lo);
+            core_run(&b, &movie, matched, lo);
+
+            chip8_t before;
+            core_get(&a, &before);
+            const uint16_t opcode = (mem_read(&before.mem, before.PC) << 8) | mem_read(&before.mem, before.PC + 1);
+            char desc[128];
+            disassemble_instruction(opcode, desc, sizeof desc);
+            printf("DIVERGED at instruction %llu (frame %llu): PC 0x%03X opcode 0x%04X  %s\n",
+                   (unsigned long long)lo, (unsigned long long)(lo / movie.per_frame), before.PC, opcode, desc);
+            free_chip8(&before);
+
+            core_run(&a, &movie, lo, hi);
+            core_run(&b, &movie, lo, hi);
+            printf("state after (%s vs %s):\n", core_names[kind_a], core_names[kind_b]);
+            print_diff(&a, &b);
+            diverged = true;
+            break;
+        }
+
+        matched = next;
+        core_save(&a, &cp_a);
+        core_save(&b, &cp_b);
+    }
+
+    if (!diverged) printf("MATCH: %llu instructions\n", (unsigned long long)matched);
+
+    core_free(&a);
+    core_free(&b);
+    free(movie.keys);
+    exit(diverged ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,298 @@
+// - - - - - - - - - - - - - - -
+//   CHIP-8 BATCH DISASSEMBLER
+// - - - - - - - - - - - - - - -
+// Disassembles whole ROM libraries using the same opcode table the interpreters dispatch
+// on. Each ROM is flow-traced from 0x200 first, so output is split into basic blocks
+// (loc_XXX:), subroutines are labelled at their call targets (sub_XXX:), jumps and calls
+// are annotated with their target label, and bytes no traced path reaches print as data.
+//
+// usage: chip8_disasm <Rom-File|Rom-Dir>... [--out DIR] [--quiet]
+//   --out DIR  write <name>.asm per ROM into DIR instead of stdout
+//   --quiet    analyse and format everything, but write nothing (for timing)
+
+#define CHIP8_NO_MAIN
+#include "chip8.c"
+
+#include <dirent.h>
+
+#define ENTRY_POINT 0x200
+
+// per-address analysis flags
+enum {
+    ADDR_CODE = 1 << 0,                   // an instruction starts here on some traced path
+    ADDR_BLOCK = 1 << 1,                  // a basic block starts here
+    ADDR_CALLED = 1 << 2,                 // a 2NNN target
+};
+
+typedef struct {
+    const char *out_dir;
+    bool quiet;
+    uint32_t roms;
+    uint64_t instructions;
+    uint64_t bytes;
+} disasm_t;
+
+// - - - - - - - - -
+// HELPER METHODS
+// - - - - - - - - -
+
+static inline uint16_t fetch(const uint8_t *ram, uint16_t addr)
+{
+    return (ram[addr & (RAM_SIZE - 1)] << 8) | ram[(addr + 1) & (RAM_SIZE - 1)];
+}
+
+// bytes the instruction at addr takes: XO-CHIP's F000 NNNN is the one two word instruction
+static inline uint32_t instruction_size(const uint8_t *ram, uint32_t addr)
+{
+    return fetch(ram, addr) == 0xF000 ? 4 : 2;
+}
+
+// follow every statically known path from the entry point, marking instructions and block starts
+static void trace_flow(const uint8_t *ram, uint32_t end, uint8_t *flags)
+{
+    static uint16_t work[RAM_SIZE];
+    uint32_t pending = 0;
+
+    flags[ENTRY_POINT] |= ADDR_BLOCK;
+    work[pending++] = ENTRY_POINT;
+
+    while (pending)
+    {
+        uint32_t addr = work[--pending];
+
+        // straight-line run until the block ends or meets code already traced
+        while (addr + 1 < end && !(flags[addr] & ADDR_CODE))
+        {
+            flags[addr] |= ADDR_CODE;
+            const uint16_t opcode = fetch(ram, addr);
+            const uint16_t target = opcode & 0x0FFF;
+
+            uint32_t branch[2];
+            uint8_t num_branches = 0;
+            bool falls_through = true;
+
+            switch (opcode_id(opcode))
+            {
+                case OP_JP:
+                    branch[num_branches++] = target;
+                    falls_through = false;
+                    break;
+
+                case OP_CALL:
+                    flags[target] |= ADDR_CALLED;
+                    branch[num_branches++] = target;
+                    branch[num_branches++] = addr + 2;
+                    falls_through = false;
+                    break;
+
+                case OP_SE: case OP_SNE: case OP_SE_V: case OP_SNE_V: case OP_SKP: case OP_SKNP:
+                    branch[num_branches++] = addr + 2;
+                    branch[num_branches++] = addr + 2 + instruction_size(ram, addr + 2);
+                    falls_through = false;
+                    break;
+
+                case OP_RET: case OP_EXIT: case OP_JP_V0: case OP_INVALID:
+                    // BNNN targets are only known at runtime; invalid opcodes are most likely data
+                    falls_through = false;
+                    break;
+
+                default:
+                    break;
+            }
+
+            for (uint8_t b = 0; b < num_branches; b++)
+            {
+                if (branch[b] >= end) continue;
+                flags[branch[b]] |= ADDR_BLOCK;
+                if (!(flags[branch[b]] & ADDR_CODE) && pending < RAM_SIZE) work[pending++] = branch[b];
+            }
+            if (!falls_through) break;
+            addr += instruction_size(ram, addr);
+        }
+    }
+}
+
+// "sub_XXX" for call targets, "loc_XXX" for other block starts
+static inline char *put_label(char *out, uint8_t flags, uint16_t addr)
+{
+    memcpy(out, (flags & ADDR_CALLED) ? "sub_" : "loc_", 4);
+    return put_hex(out + 4, addr, addr > 0xFFF ? 4 : 3);
+}
+
+static inline char *put_str(char *out, const char *str)
+{
+    while (*str) *out++ = *str++;
+    return out;
+}
+
+// write one ROM's listing; returns the number of instructions. Lines are formatted by hand
+// into one buffer rather than through printf, which is most of the cost on big libraries
+static uint64_t disassemble_rom(const uint8_t *ram, uint32_t end, FILE *out)
+{
+    static uint8_t flags[RAM_SIZE];
+    static char listing[RAM_SIZE * 64];
+    memset(flags, 0, sizeof flags);
+    trace_flow(ram, end, flags);
+
+    uint64_t instructions = 0;
+    char *line = listing;
+    for (uint32_t addr = ENTRY_POINT; addr < end; )
+    {
+        if (flags[addr] & ADDR_CALLED) *line++ = '\n';
+        if (flags[addr] & (ADDR_BLOCK | ADDR_CALLED))
+        {
+            line = put_label(line, flags[addr], addr);
+            line = put_str(line, ":\n");
+        }
+
+        line = put_str(line, "    0x");
+        line = put_hex(line, addr, addr > 0xFFF ? 4 : 3);
+        line = put_str(line, "  ");
+
+        if (!(flags[addr] & ADDR_CODE))
+        {
+            line = put_hex(line, ram[addr], 2);
+            line = put_str(line, "    DB   0x");
+            line = put_hex(line, ram[addr], 2);
+            *line++ = '\n';
+            addr++;
+            continue;
+        }
+
+        const uint16_t opcode = fetch(ram, addr);
+        line = put_hex(line, opcode, 4);
+        line = put_str(line, "  ");
+        char *const start = line;
+        line += disassemble_mnemonic(opcode, line, 32);
+
+        // F000 NNNN: the address is the second word
+        const opcode_id_t id = opcode_id(opcode);
+        if (id == OP_LONG)
+        {
+            line = put_str(start, "LD   I, 0x");
+            line = put_hex(line, fetch(ram, addr + 2), 4);
+        }
+        else if (id == OP_JP || id == OP_CALL || id == OP_JP_V0)
+        {
+            while (line < start + 20) *line++ = ' ';
+            line = put_str(line, "; ");
+            line = id == OP_JP_V0 ? put_str(line, "indirect") : put_label(line, flags[opcode & 0x0FFF], opcode & 0x0FFF);
+        }
+        *line++ = '\n';
+
+        instructions++;
+        addr += instruction_size(ram, addr);
+    }
+
+    if (out) fwrite(listing, 1, line - listing, out);
+    return instructions;
+}
+
+static void disassemble_file(disasm_t *ds, const char *path)
+{
+    FILE *rom = fopen(path, "rb");
+    if (!rom)
+    {
+        fprintf(stderr, "Could not open ROM %s\n", path);
+        return;
+    }
+
+    static uint8_t ram[RAM_SIZE];
+    memset(ram, 0, sizeof ram);
+    const size_t size = fread(&ram[ENTRY_POINT], 1, RAM_SIZE - ENTRY_POINT, rom);
+    fclose(rom);
+
+    FILE *out = ds->quiet ? NULL : stdout;
+    if (!ds->quiet && ds->out_dir)
+    {
+        // <out>/<file name without directory or extension>.asm
+        const char *name = path;
+        for (const char *c = path; *c; c++)
+        {
+            if (*c == '/' || *c == '\\') name = c + 1;
+        }
+        const char *ext = strrchr(name, '.');
+        const int stem = ext ? (int)(ext - name) : (int)strlen(name);
+
+        char out_path[1024];
+        snprintf(out_path, sizeof out_path, "%s/%.*s.asm", ds->out_dir, stem, name);
+        out = fopen(out_path, "w");
+        if (!out)
+        {
+            fprintf(stderr, "Could not write %s\n", out_path);
+            return;
+        }
+    }
+    else if (out)
+    {
+        fprintf(out, "; %s\n", path);
+    }
+
+    ds->instructions += disassemble_rom(ram, ENTRY_POINT + size, out);
+    ds->bytes += size;
+    ds->roms++;
+
+    if (out && out != stdout) fclose(out);
+    else if (out) fprintf(out, "\n");
+}
+
+// a ROM file, or every ROM (.ch8, .sc8 or .xo8) in a directory
+static void disassemble_path(disasm_t *ds, const char *path)
+{
+    DIR *dir = opendir(path);
+    if (!dir)
+    {
+        disassemble_file(ds, path);
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)))
+    {
+        const size_t len = strlen(entry->d_name);
+        if (len < 5 || !is_rom_name(entry->d_name)) continue;
+
+        char rom_path[1024];
+        snprintf(rom_path, sizeof rom_path, "%s/%s", path, entry->d_name);
+        disassemble_file(ds, rom_path);
+    }
+    closedir(dir);
+}
+
+// - - - - - - - - -
+// MAIN PROGRAM
+// - - - - - - - - -
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <Rom-File|Rom-Dir>... [--out DIR] [--quiet]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    disasm_t ds = {0};
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--out") && i + 1 < argc) ds.out_dir = argv[++i];
+        else if (!strcmp(argv[i], "--quiet")) ds.quiet = true;
+    }
+
+    static char buffer[1 << 20];
+    setvbuf(stdout, buffer, _IOFBF, sizeof buffer);
+    decode_init();
+
+    const uint64_t start = SDL_GetPerformanceCounter();
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--out")) i++;
+        else if (strcmp(argv[i], "--quiet")) disassemble_path(&ds, argv[i]);
+    }
+    fflush(stdout);
+    const double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+
+    fprintf(stderr, "%u ROMs, %llu bytes, %llu instructions in %.3f s (%.2f M instructions/s)\n",
+            ds.roms, (unsigned long long)ds.bytes, (unsigned long long)ds.instructions, seconds,
+            seconds > 0 ? ds.instructions / seconds / 1e6 : 0.0);
+    exit(ds.roms ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,301 @@
+// - - - - - - - - - - - - - - - -
+//   CHIP-8 BATCHED ENVIRONMENT
+// - - - - - - - - - - - - - - - -
+// see chip8_env.h for the API
+
+#define _POSIX_C_SOURCE 200809L          // shm_open, ftruncate, mmap
+
+#define CHIP8_NO_MAIN
+#include "chip8.c"
+#include "chip8_env.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+struct chip8_env {
+    chip8_batch_t *batches;               // ceil(num_envs / BATCH_LANES) batches
+    uint32_t num_batches;
+    uint32_t num_envs;
+    chip8_image_t image;                  // font + ROM, shared read-only by every instance
+    chip8_t initial;                      // freshly loaded machine, copied in on reset
+    uint32_t seed;                        // CXNN random state of instance 0 after a reset; instance i gets seed + i
+    uint8_t *obs;                         // num_envs * CHIP8_ENV_OBS_SIZE bytes
+    bool owns_obs;                        // obs was allocated by us
+    char *shm_name;                       // non-NULL when obs is a shared memory mapping
+    uint32_t frame_skip;
+    uint32_t instructs_per_frame;
+    chip8_reward_fn reward;
+    void *reward_user;
+};
+
+// - - - - - - - - -
+// HELPER METHODS
+// - - - - - - - - -
+
+// pixels of display row y lit on any plane; lo-res only looks at the left half, which every display has
+static inline display_row_t lit_pixels(const display_plane_t *display, uint8_t planes, bool hires, uint32_t y)
+{
+    display_row_t lit = { 0, 0 };
+    for (uint32_t p = 0; p < planes; p++) lit = row_or(lit, row_get(display, p, y, hires));
+    return lit;
+}
+
+// pack one lane's display into a 64x32 1bpp bitmap; hi-res pixels are ORed down 2x2
+static void pack_observation(const display_plane_t *display, uint8_t planes, bool hires, uint8_t *obs)
+{
+    for (uint32_t y = 0; y < DISPLAY_HEIGHT / 2; y++)
+    {
+        uint64_t bits = lit_pixels(display, planes, hires, y).hi;
+        if (hires)
+        {
+            const display_row_t pair = row_or(lit_pixels(display, planes, hires, 2 * y),
+                                              lit_pixels(display, planes, hires, 2 * y + 1));
+            bits = 0;
+            for (uint32_t x = 0; x < DISPLAY_WIDTH / 2; x++)
+            {
+                const uint64_t word = x < 32 ? pair.hi : pair.lo;
+                bits = bits << 1 | (uint64_t)((word >> (62 - 2 * (x % 32))) & 3 ? 1 : 0);
+            }
+        }
+        for (uint32_t i = 0; i < 8; i++) obs[y * 8 + i] = bits >> (56 - 8 * i);
+    }
+}
+
+static chip8_env_t *env_alloc(char *rom_name, uint32_t num_envs)
+{
+    if (num_envs == 0) return NULL;
+
+    chip8_env_t *env = calloc(1, sizeof *env);
+    if (!env) return NULL;
+
+    if (!load_chip8_image(&env->image, rom_name, platform_from_rom_name(rom_name)))
+    {
+        free(env);
+        return NULL;
+    }
+    init_chip8_shared(&env->initial, &env->image, rom_name);
+    env->seed = env->initial.rng;
+
+    env->num_envs = num_envs;
+    env->num_batches = (num_envs + BATCH_LANES - 1) / BATCH_LANES;
+    env->batches = calloc(env->num_batches, sizeof *env->batches);
+    if (!env->batches)
+    {
+        free_chip8(&env->initial);
+        free(env);
+        return NULL;
+    }
+
+    // padding lanes in the last batch run too, so every lane needs a valid machine
+    for (uint32_t b = 0; b < env->num_batches; b++)
+    {
+        init_chip8_batch(&env->batches[b], &env->image, rom_name);
+    }
+
+    env->frame_skip = 1;
+    env->instructs_per_frame = INSTRUCTS_PER_SECOND / 60;
+    return env;
+}
+
+// - - - - - - - - -
+// API
+// - - - - - - - - -
+
+chip8_env_t *chip8_env_create(char *rom_name, uint32_t num_envs, uint8_t *obs_buffer)
+{
+    chip8_env_t *env = env_alloc(rom_name, num_envs);
+    if (!env) return NULL;
+
+    env->obs = obs_buffer;
+    if (!env->obs)
+    {
+        env->obs = calloc(num_envs, CHIP8_ENV_OBS_SIZE);
+        env->owns_obs = true;
+        if (!env->obs)
+        {
+            chip8_env_destroy(env);
+            return NULL;
+        }
+    }
+
+    chip8_env_reset(env, NULL);
+    return env;
+}
+
+chip8_env_t *chip8_env_create_shm(char *rom_name, uint32_t num_envs, const char *shm_name)
+{
+#ifdef _WIN32
+    (void)rom_name; (void)num_envs;
+    SDL_Log("Shared memory observations (%s) are not supported on this platform\n", shm_name);
+    return NULL;
+#else
+    chip8_env_t *env = env_alloc(rom_name, num_envs);
+    if (!env) return NULL;
+
+    const size_t size = (size_t)num_envs * CHIP8_ENV_OBS_SIZE;
+    const int fd = shm_open(shm_name, O_CREAT | O_RDWR, 0600);
+    if (fd < 0 || ftruncate(fd, size) != 0)
+    {
+        SDL_Log("Could not create shared memory segment %s\n", shm_name);
+        if (fd >= 0) close(fd);
+        chip8_env_destroy(env);
+        return NULL;
+    }
+
+    void *obs = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);                            // the mapping keeps the segment alive
+    if (obs == MAP_FAILED)
+    {
+        SDL_Log("Could not map shared memory segment %s\n", shm_name);
+        shm_unlink(shm_name);
+        chip8_env_destroy(env);
+        return NULL;
+    }
+
+    env->obs = obs;
+    env->shm_name = malloc(strlen(shm_name) + 1);
+    if (!env->shm_name)
+    {
+        // destroy only unmaps named segments, so drop this one here
+        munmap(obs, size);
+        shm_unlink(shm_name);
+        env->obs = NULL;
+        chip8_env_destroy(env);
+        return NULL;
+    }
+    strcpy(env->shm_name, shm_name);
+
+    chip8_env_reset(env, NULL);
+    return env;
+#endif
+}
+
+void chip8_env_destroy(chip8_env_t *env)
+{
+    if (!env) return;
+
+#ifndef _WIN32
+    if (env->shm_name)
+    {
+        munmap(env->obs, (size_t)env->num_envs * CHIP8_ENV_OBS_SIZE);
+        shm_unlink(env->shm_name);
+        free(env->shm_name);
+    }
+#endif
+    if (env->owns_obs) free(env->obs);
+    for (uint32_t b = 0; b < env->num_batches; b++) free_chip8_batch(&env->batches[b]);
+    free(env->batches);
+    free_chip8(&env->initial);
+    free(env);
+}
+
+void chip8_env_set_reward(chip8_env_t *env, chip8_reward_fn reward, void *user)
+{
+    env->reward = reward;
+    env->reward_user = user;
+}
+
+void chip8_env_set_frame_skip(chip8_env_t *env, uint32_t frames)
+{
+    env->frame_skip = frames ? frames : 1;
+}
+
+void chip8_env_set_speed(chip8_env_t *env, uint32_t instructs_per_second)
+{
+    env->instructs_per_frame = instructs_per_second / 60;
+}
+
+void chip8_env_set_seed(chip8_env_t *env, uint32_t seed)
+{
+    env->seed = seed;
+}
+
+void chip8_env_set_deferred_drawing(chip8_env_t *env, bool on)
+{
+    for (uint32_t b = 0; b < env->num_batches; b++)
+    {
+        for (uint32_t l = 0; l < BATCH_LANES; l++) batch_flush_lane(&env->batches[b], l);
+        env->batches[b].defer_draws = on;
+    }
+}
+
+void chip8_env_reset(chip8_env_t *env, const uint8_t *which)
+{
+    for (uint32_t i = 0; i < env->num_envs; i++)
+    {
+        if (which && !which[i]) continue;
+
+        chip8_batch_t *batch = &env->batches[i / BATCH_LANES];
+        batch_set_lane(batch, i % BATCH_LANES, &env->initial);
+
+        // each instance draws its own CXNN numbers. Nearby seeds would start xorshift on the same top
+        // byte, so seed + i is spread by an odd multiply (one to one); xorshift never leaves 0, so
+        // that one keeps the machine's default seed
+        const uint32_t rng = (env->seed + i) * 0x9E3779B1u;
+        batch->rng[i % BATCH_LANES] = rng ? rng : env->initial.rng;
+        pack_observation(batch->display[i % BATCH_LANES], batch->display_planes, batch->hires[i % BATCH_LANES],
+                         &env->obs[(size_t)i * CHIP8_ENV_OBS_SIZE]);
+    }
+}
+
+void chip8_env_step(chip8_env_t *env, const uint16_t *actions, float *rewards, uint8_t *dones)
+{
+    for (uint32_t b = 0; b < env->num_batches; b++)
+    {
+        chip8_batch_t *batch = &env->batches[b];
+
+        // map actions onto each lane's keypad; padding lanes past num_envs keep theirs
+        for (uint32_t l = 0; l < BATCH_LANES; l++)
+        {
+            const uint32_t i = b * BATCH_LANES + l;
+            if (i >= env->num_envs) break;
+            for (uint8_t k = 0; k < 16; k++) batch->keypad[l][k] = (actions[i] >> k) & 1;
+        }
+
+        // emulate frame_skip 60hz frames
+        for (uint32_t f = 0; f < env->frame_skip; f++)
+        {
+            batch_emulate_instructions(batch, env->instructs_per_frame);
+            batch_update_timers(batch);
+        }
+        for (uint32_t l = 0; l < BATCH_LANES; l++) batch_flush_lane(batch, l);
+    }
+
+    for (uint32_t i = 0; i < env->num_envs; i++)
+    {
+        const chip8_batch_t *batch = &env->batches[i / BATCH_LANES];
+        pack_observation(batch->display[i % BATCH_LANES], batch->display_planes, batch->hires[i % BATCH_LANES],
+                         &env->obs[(size_t)i * CHIP8_ENV_OBS_SIZE]);
+
+        bool done = false;
+        const float reward = env->reward ? env->reward(env, i, &done, env->reward_user) : 0.0f;
+        if (rewards) rewards[i] = reward;
+        // SCHIP 00FD (exit) ends an instance's episode whatever the reward hook says
+        if (dones) dones[i] = done || batch->exited[i % BATCH_LANES];
+    }
+}
+
+uint8_t *chip8_env_observations(const chip8_env_t *env)
+{
+    return env->obs;
+}
+
+uint32_t chip8_env_count(const chip8_env_t *env)
+{
+    return env->num_envs;
+}
+
+uint8_t chip8_env_read(const chip8_env_t *env, uint32_t index, uint16_t addr)
+{
+    if (index >= env->num_envs) return 0;  // padding lanes and beyond are not envs
+    return mem_read(&env->batches[index / BATCH_LANES].mem[index % BATCH_LANES], addr);
+}
+
+uint8_t chip8_env_register(const chip8_env_t *env, uint32_t index, uint8_t reg)
+{
+    if (index >= env->num_envs) return 0;
+    return env->batches[index / BATCH_LANES].V[reg & 0xF][index % BATCH_LANES];
+}
@@ -0,0 +1,56 @@
+// - - - - - - - - - - - - - - - -
+//   CHIP-8 BATCHED ENVIRONMENT API
+// - - - - - - - - - - - - - - - -
+// Gym-style reset/step over N instances of one ROM, built on the SoA batch core.
+// Observations are packed 1bpp display bitmaps (64x32 -> 256 bytes per instance,
+// MSB = leftmost pixel; SCHIP hi-res screens are ORed down 2x2 to fit) written
+// straight into a caller owned buffer or a POSIX
+// shared memory segment, so training processes read frames without a copy.
+
+#ifndef CHIP8_ENV_H
+#define CHIP8_ENV_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CHIP8_ENV_OBS_SIZE (64 * 32 / 8)  // bytes per observation
+
+typedef struct chip8_env chip8_env_t;
+
+// reward hook: called once per instance after every step; may set *done
+typedef float (*chip8_reward_fn)(const chip8_env_t *env, uint32_t index, bool *done, void *user);
+
+// create N instances of a ROM; obs_buffer must hold num_envs * CHIP8_ENV_OBS_SIZE bytes,
+// or be NULL to have the environment allocate it
+chip8_env_t *chip8_env_create(char *rom_name, uint32_t num_envs, uint8_t *obs_buffer);
+
+// as above, with observations placed in a POSIX shared memory segment (e.g. "/chip8_obs")
+chip8_env_t *chip8_env_create_shm(char *rom_name, uint32_t num_envs, const char *shm_name);
+
+void chip8_env_destroy(chip8_env_t *env);
+
+void chip8_env_set_reward(chip8_env_t *env, chip8_reward_fn reward, void *user);
+void chip8_env_set_frame_skip(chip8_env_t *env, uint32_t frames);    // emulated 60hz frames per step
+void chip8_env_set_speed(chip8_env_t *env, uint32_t instructs_per_second);
+void chip8_env_set_seed(chip8_env_t *env, uint32_t seed);            // CXNN state of instance i comes from seed + i on each reset
+
+// record DXYN and draw sprites only when a step's observation is taken (or collision is read);
+// with frame skip most draws are then cleared or undone before they are ever rasterized
+void chip8_env_set_deferred_drawing(chip8_env_t *env, bool on);
+
+// reset every instance, or only those with which[i] != 0
+void chip8_env_reset(chip8_env_t *env, const uint8_t *which);
+
+// actions[i] is a 16 bit keypad mask for instance i (bit k = key k held);
+// rewards and dones may be NULL. An instance is done when the reward hook says so, or once it
+// has run SCHIP 00FD (exit); reset it to start again
+void chip8_env_step(chip8_env_t *env, const uint16_t *actions, float *rewards, uint8_t *dones);
+
+// observation buffer and instance state, for reward hooks and inspection
+uint8_t *chip8_env_observations(const chip8_env_t *env);
+uint32_t chip8_env_count(const chip8_env_t *env);
+uint8_t chip8_env_read(const chip8_env_t *env, uint32_t index, uint16_t addr);   // ram byte, 0 past num_envs
+uint8_t chip8_env_register(const chip8_env_t *env, uint32_t index, uint8_t reg);  // VX, 0 past num_envs
+
+#endif
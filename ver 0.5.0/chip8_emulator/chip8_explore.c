@@ -0,0 +1,307 @@
+// - - - - - - - - - - - - - - -
+//   CHIP-8 STATE-SPACE EXPLORER
+// - - - - - - - - - - - - - - -
+// Explores the states a ROM can reach, level by level across worker threads. Every state
+// is expanded by holding each of the 16 keys (and no key) for K frames; the resulting
+// machines are content hashed into a lock-free set so duplicates are pruned, and the
+// search stops when a state meets the goal. Prints the key sequence that reaches it.
+//
+// usage: chip8_explore <Rom-Name> [--frames K] [--threads T] [--depth D] [--max-states N]
+//                      [--goal-pc ADDR] [--goal-ram ADDR=VAL] [--score ADDR --beam W]
+//   --score/--beam turn breadth-first into best-first (beam) search: each level keeps
+//   only the W states with the highest ram byte at ADDR.
+
+#define CHIP8_NO_MAIN
+#include "chip8.c"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define NO_KEY 16                         // expansion that holds no key
+#define NO_PARENT UINT32_MAX
+
+// explored state: a checkpoint plus how we got there
+typedef struct {
+    chip8_checkpoint_t cp;
+    uint32_t parent;                      // index of the state expanded to reach this one
+    uint8_t key;                          // key held for the K frames from parent
+    uint8_t score;                        // ram[score_addr] for beam search
+} state_t;
+
+// search configuration and shared state
+typedef struct {
+    chip8_image_t image;
+    char *rom_name;
+    uint32_t frames;                      // K: frames each key is held
+    uint32_t threads;
+    uint32_t max_depth;
+    uint32_t max_states;
+    int32_t goal_pc;                      // -1 when unused
+    int32_t goal_addr;                    // -1 when unused
+    uint8_t goal_val;
+    int32_t score_addr;                   // -1 for plain breadth-first
+    uint32_t beam;
+
+    state_t *states;
+    _Atomic uint32_t num_states;
+
+    _Atomic uint64_t *seen;               // open addressing set of state hashes; 0 = empty
+    uint64_t seen_mask;
+
+    uint32_t *frontier;                   // states to expand this level
+    uint32_t frontier_size;
+    _Atomic uint32_t next_frontier_item;  // work queue position in frontier
+    uint32_t *next;                       // states found this level
+    _Atomic uint32_t next_size;
+
+    _Atomic uint32_t goal;                // state index that met the goal, or NO_PARENT
+    _Atomic uint64_t expanded;
+    _Atomic uint64_t duplicates;
+} explorer_t;
+
+// - - - - - - - - -
+// HELPER METHODS
+// - - - - - - - - -
+
+// insert a hash; returns true if it was not already in the set. Probing gives up after every
+// slot has been looked at once, so a full set reports states as seen rather than spinning
+static bool seen_insert(explorer_t *ex, uint64_t h)
+{
+    if (h == 0) h = 1;                    // 0 marks an empty slot
+
+    uint64_t i = h & ex->seen_mask;
+    for (uint64_t probe = 0; probe <= ex->seen_mask; probe++, i = (i + 1) & ex->seen_mask)
+    {
+        uint64_t cur = atomic_load_explicit(&ex->seen[i], memory_order_relaxed);
+        if (cur == h) return false;
+        if (cur == 0)
+        {
+            if (atomic_compare_exchange_strong(&ex->seen[i], &cur, h)) return true;
+            if (cur == h) return false;   // lost the race to the same state
+        }
+    }
+    return false;
+}
+
+static bool is_goal(const explorer_t *ex, const chip8_t *chip8)
+{
+    if (ex->goal_pc >= 0 && chip8->PC == ex->goal_pc) return true;
+    if (ex->goal_addr >= 0 && mem_read(&chip8->mem, ex->goal_addr) == ex->goal_val) return true;
+    return false;
+}
+
+static void *explore_worker(void *arg)
+{
+    explorer_t *ex = arg;
+    chip8_t chip8 = {0};
+    init_chip8_shared(&chip8, &ex->image, ex->rom_name);
+
+    // once max_states is reached every worker stops, not just the one that filled it
+    bool full = false;
+    while (!full)
+    {
+        const uint32_t item = atomic_fetch_add(&ex->next_frontier_item, 1);
+        if (item >= ex->frontier_size) break;
+        if (atomic_load(&ex->goal) != NO_PARENT) break;
+
+        const uint32_t parent = ex->frontier[item];
+        for (uint8_t key = 0; key <= NO_KEY; key++)
+        {
+            // no room left: don't expand, or fill the seen set with, states that can't be kept
+            if (atomic_load(&ex->num_states) >= ex->max_states)
+            {
+                full = true;
+                break;
+            }
+
+            restore_chip8(&chip8, &ex->states[parent].cp);
+            memset(chip8.keypad, false, sizeof chip8.keypad);
+            if (key != NO_KEY) chip8.keypad[key] = true;
+
+            for (uint32_t f = 0; f < ex->frames; f++) run_frame(&chip8);
+            atomic_fetch_add_explicit(&ex->expanded, 1, memory_order_relaxed);
+
+            if (!seen_insert(ex, hash_chip8(&chip8)))
+            {
+                atomic_fetch_add_explicit(&ex->duplicates, 1, memory_order_relaxed);
+                continue;
+            }
+
+            const uint32_t idx = atomic_fetch_add(&ex->num_states, 1);
+            if (idx >= ex->max_states)
+            {
+                full = true;
+                break;
+            }
+
+            state_t *state = &ex->states[idx];
+            checkpoint_chip8(&chip8, &state->cp);
+            state->parent = parent;
+            state->key = key;
+            state->score = ex->score_addr >= 0 ? mem_read(&chip8.mem, ex->score_addr) : 0;
+
+            ex->next[atomic_fetch_add(&ex->next_size, 1)] = idx;
+
+            if (is_goal(ex, &chip8))
+            {
+                uint32_t none = NO_PARENT;
+                atomic_compare_exchange_strong(&ex->goal, &none, idx);
+            }
+        }
+    }
+
+    free_chip8(&chip8);
+    return NULL;
+}
+
+static explorer_t *sort_ex;               // qsort has no context argument in C17
+static int by_score(const void *a, const void *b)
+{
+    const uint8_t sa = sort_ex->states[*(const uint32_t *)a].score;
+    const uint8_t sb = sort_ex->states[*(const uint32_t *)b].score;
+    return (sb > sa) - (sb < sa);
+}
+
+static void print_path(const explorer_t *ex, uint32_t idx)
+{
+    uint32_t depth = 0;
+    for (uint32_t i = idx; ex->states[i].parent != NO_PARENT; i = ex->states[i].parent) depth++;
+
+    uint8_t *keys = malloc(depth ? depth : 1);
+    uint32_t d = depth;
+    for (uint32_t i = idx; ex->states[i].parent != NO_PARENT; i = ex->states[i].parent) keys[--d] = ex->states[i].key;
+
+    printf("Goal reached after %u steps of %u frames. Keys held:", depth, ex->frames);
+    for (uint32_t i = 0; i < depth; i++)
+    {
+        if (keys[i] == NO_KEY) printf(" -");
+        else printf(" %X", keys[i]);
+    }
+    printf("\n");
+    free(keys);
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// - - - - - - - - -
+// MAIN PROGRAM
+// - - - - - - - - -
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <Rom-Name> [--frames K] [--threads T] [--depth D] [--max-states N] "
+                        "[--goal-pc ADDR] [--goal-ram ADDR=VAL] [--score ADDR --beam W]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    static explorer_t ex;
+    ex.rom_name = argv[1];
+    ex.frames = 10;
+    ex.threads = 4;
+    ex.max_depth = 64;
+    ex.max_states = 20000;
+    ex.goal_pc = ex.goal_addr = ex.score_addr = -1;
+
+    for (int i = 2; i < argc; i++)
+    {
+        const bool has_val = i + 1 < argc;
+        if (!strcmp(argv[i], "--frames") && has_val) ex.frames = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--threads") && has_val) ex.threads = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--depth") && has_val) ex.max_depth = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--max-states") && has_val) ex.max_states = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--goal-pc") && has_val) ex.goal_pc = strtol(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--score") && has_val) ex.score_addr = strtol(argv[++i], NULL, 0) & (RAM_SIZE - 1);
+        else if (!strcmp(argv[i], "--beam") && has_val) ex.beam = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--goal-ram") && has_val)
+        {
+            char *eq;
+            ex.goal_addr = strtol(argv[++i], &eq, 0) & (RAM_SIZE - 1);
+            ex.goal_val = *eq == '=' ? strtoul(eq + 1, NULL, 0) : 0;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown or incomplete option %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (ex.threads == 0) ex.threads = 1;
+    if (ex.max_states < 2) ex.max_states = 2;
+
+    if (!load_chip8_image(&ex.image, ex.rom_name, platform_from_rom_name(ex.rom_name))) exit(EXIT_FAILURE);
+
+    // set sized for a load factor under one half
+    uint64_t slots = 1;
+    while (slots < (uint64_t)ex.max_states * 2) slots <<= 1;
+    ex.seen = calloc(slots, sizeof *ex.seen);
+    ex.seen_mask = slots - 1;
+
+    ex.states = calloc(ex.max_states, sizeof *ex.states);   // zeroed: checkpoints start with no ram buffer
+    ex.frontier = malloc((size_t)ex.max_states * sizeof *ex.frontier);
+    ex.next = malloc((size_t)ex.max_states * sizeof *ex.next);
+    if (!ex.seen || !ex.states || !ex.frontier || !ex.next)
+    {
+        fprintf(stderr, "Could not allocate room for %u states\n", ex.max_states);
+        exit(EXIT_FAILURE);
+    }
+
+    // root state
+    chip8_t root = {0};
+    init_chip8_shared(&root, &ex.image, ex.rom_name);
+    checkpoint_chip8(&root, &ex.states[0].cp);
+    ex.states[0].parent = NO_PARENT;
+    seen_insert(&ex, hash_chip8(&root));
+    atomic_store(&ex.num_states, 1);
+    atomic_store(&ex.goal, is_goal(&ex, &root) ? 0 : NO_PARENT);
+
+    ex.frontier[0] = 0;
+    ex.frontier_size = 1;
+
+    pthread_t *workers = malloc(ex.threads * sizeof *workers);
+    const double start = now_seconds();
+    uint32_t depth = 0;
+
+    while (ex.frontier_size && depth < ex.max_depth && atomic_load(&ex.goal) == NO_PARENT &&
+           atomic_load(&ex.num_states) < ex.max_states)
+    {
+        atomic_store(&ex.next_frontier_item, 0);
+        atomic_store(&ex.next_size, 0);
+
+        for (uint32_t t = 0; t < ex.threads; t++) pthread_create(&workers[t], NULL, explore_worker, &ex);
+        for (uint32_t t = 0; t < ex.threads; t++) pthread_join(workers[t], NULL);
+
+        // next level becomes the frontier; beam search keeps only the best scoring states
+        uint32_t size = atomic_load(&ex.next_size);
+        if (ex.score_addr >= 0 && ex.beam)
+        {
+            sort_ex = &ex;
+            qsort(ex.next, size, sizeof *ex.next, by_score);
+            if (size > ex.beam) size = ex.beam;
+        }
+        if (size > ex.max_states) size = ex.max_states;
+        memcpy(ex.frontier, ex.next, size * sizeof *ex.frontier);
+        ex.frontier_size = size;
+        depth++;
+
+        uint32_t found = atomic_load(&ex.num_states);
+        printf("depth %u: %u states, frontier %u\n", depth, found < ex.max_states ? found : ex.max_states, size);
+    }
+
+    const double elapsed = now_seconds() - start;
+    const uint64_t expanded = atomic_load(&ex.expanded);
+    printf("%llu expansions (%llu duplicates) in %.2fs, %.0f expansions/s\n",
+           (unsigned long long)expanded, (unsigned long long)atomic_load(&ex.duplicates),
+           elapsed, elapsed > 0 ? expanded / elapsed : 0.0);
+
+    const uint32_t goal = atomic_load(&ex.goal);
+    if (goal != NO_PARENT) print_path(&ex, goal);
+    else printf("Goal not reached\n");
+
+    exit(goal != NO_PARENT ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,103 @@
+// - - - - - - - - - - - - -
+//   CHIP-8 FUZZ HARNESS
+// - - - - - - - - - - - - -
+// Persistent-mode, libFuzzer compatible harness that fuzzes the keypad input of one ROM.
+// The ROM is loaded and checkpointed once; every input restores the checkpoint (copying
+// back only the pages the last run dirtied) and plays the input as a keypad movie:
+// each 2 bytes are a 16 bit keypad mask held for one 60hz frame.
+//
+// ROM PCs reached are exported as libFuzzer extra counters, so coverage is measured over
+// the ROM's code rather than just the interpreter's.
+//
+// usage: CHIP8_FUZZ_ROM=game.ch8 ./chip8_fuzz corpus/
+//   build with -DCHIP8_FUZZ_STANDALONE for a plain replay binary: ./chip8_fuzz game.ch8 input...
+
+#define CHIP8_NO_MAIN
+#include "chip8.c"
+
+#define FUZZ_MAX_FRAMES 3600              // cap one input at a minute of emulated time
+
+#if defined(__linux__) && !defined(CHIP8_FUZZ_STANDALONE)
+__attribute__((section("__libfuzzer_extra_counters")))
+#endif
+static uint8_t pc_coverage[RAM_SIZE];
+
+static chip8_t fuzz_chip8;
+static chip8_checkpoint_t fuzz_start;
+static bool fuzz_ready = false;
+
+static bool fuzz_setup(char *rom_name)
+{
+    if (!rom_name)
+    {
+        fprintf(stderr, "Set CHIP8_FUZZ_ROM to the ROM to fuzz\n");
+        return false;
+    }
+    if (!init_chip8(&fuzz_chip8, rom_name, platform_from_rom_name(rom_name))) return false;
+
+    checkpoint_chip8(&fuzz_chip8, &fuzz_start);
+    fuzz_ready = true;
+    return true;
+}
+
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+    (void)argc;
+    (void)argv;
+    return fuzz_setup(getenv("CHIP8_FUZZ_ROM")) ? 0 : 1;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (!fuzz_ready) return 0;
+
+    restore_chip8(&fuzz_chip8, &fuzz_start);
+    const chip8_step_fn step = chip8_stepper(fuzz_chip8.platform, false);
+
+    for (size_t f = 0; f + 1 < size && f / 2 < FUZZ_MAX_FRAMES; f += 2)
+    {
+        const uint16_t keys = (data[f] << 8) | data[f + 1];
+        for (uint8_t k = 0; k < 16; k++) fuzz_chip8.keypad[k] = (keys >> k) & 1;
+
+        for (uint32_t i = 0; i < INSTRUCTS_PER_SECOND / 60; i++)
+        {
+            pc_coverage[fuzz_chip8.PC & (RAM_SIZE - 1)] = 1;
+            step(&fuzz_chip8, NULL);
+        }
+        update_timers(&fuzz_chip8);
+    }
+    return 0;
+}
+
+#ifdef CHIP8_FUZZ_STANDALONE
+// replay inputs (e.g. crashes found by the fuzzer) without libFuzzer
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s <Rom-Name> <input>...\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (!fuzz_setup(argv[1])) exit(EXIT_FAILURE);
+
+    for (int i = 2; i < argc; i++)
+    {
+        FILE *in = fopen(argv[i], "rb");
+        if (!in)
+        {
+            fprintf(stderr, "Could not open input %s\n", argv[i]);
+            continue;
+        }
+
+        static uint8_t data[FUZZ_MAX_FRAMES * 2];
+        const size_t size = fread(data, 1, sizeof data, in);
+        fclose(in);
+
+        LLVMFuzzerTestOneInput(data, size);
+        printf("%s: PC 0x%03X after %u frames\n", argv[i], fuzz_chip8.PC, (unsigned)(size / 2));
+    }
+
+    free_chip8(&fuzz_chip8);
+    exit(EXIT_SUCCESS);
+}
+#endif
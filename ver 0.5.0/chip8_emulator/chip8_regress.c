@@ -0,0 +1,302 @@
+// - - - - - - - - - - - - - - - - -
+//   CHIP-8 REGRESSION RUNNER
+// - - - - - - - - - - - - - - - - -
+// Headless: never opens a window, so it runs in CI. Every ROM in a directory is run for a
+// fixed number of frames with its scripted input and the display is hashed at chosen
+// frames and checked against a golden file. ROMs run in parallel across worker threads.
+//
+// for each <name>.ch8 in the directory (COSMAC, SCHIP and XO-CHIP ROMs keep their extension in <name>,
+// e.g. game.sc8.golden, so ROMs of one name on several platforms don't share files):
+//   <name>.keys    optional input movie, "<frame> <hex keymask>" per line
+//   <name>.golden  "<frame> <hex display hash>" per line; frames listed are the ones checked.
+//                  Missing (or --update): written from this run, every --every frames
+//
+// --smc runs the profiled core and reports, per ROM, how often it executed instructions it had
+// rewritten since they last ran, and at how many addresses; the summary counts self-modifying ROMs
+//
+// usage: chip8_regress <Rom-Dir> [--jobs J] [--frames F] [--every E] [--update] [--smc]
+
+#define CHIP8_NO_MAIN
+#include "chip8.c"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define MAX_CHECKS 1024                   // display hashes per golden file
+
+typedef enum {
+    RESULT_PASS,
+    RESULT_FAIL,
+    RESULT_NEW,                           // golden written
+    RESULT_ERROR,
+} result_t;
+
+static const char *result_names[] = { "PASS", "FAIL", "NEW ", "ERR " };
+
+typedef struct {
+    char name[256];                       // file name, without .ch8 for CHIP-8 ROMs
+    char ext[8];                          // what name leaves off the file name: ".ch8" or nothing
+    result_t result;
+    char detail[256];
+    uint64_t rewrites;                    // --smc: rewritten instructions executed
+    uint32_t rewritten_addrs;             // --smc: addresses that happened at
+} test_t;
+
+typedef struct {
+    const char *dir;
+    uint32_t frames;
+    uint32_t every;
+    bool update;
+    bool smc;
+    test_t *tests;
+    uint32_t num_tests;
+    _Atomic uint32_t next_test;
+} regress_t;
+
+// - - - - - - - - -
+// HELPER METHODS
+// - - - - - - - - -
+
+// frames to check and their expected hashes; returns how many, or -1 with no golden file
+static int read_golden(const char *path, uint32_t *frames, uint64_t *hashes)
+{
+    FILE *in = fopen(path, "r");
+    if (!in) return -1;
+
+    int n = 0;
+    unsigned long long hash;
+    while (n < MAX_CHECKS && fscanf(in, "%u %llx", &frames[n], &hash) == 2) hashes[n++] = hash;
+    fclose(in);
+    return n;
+}
+
+// run_frame on the profiled core, which counts self-modifying code
+static void run_frame_profiled(chip8_t *chip8, chip8_profile_t *profile)
+{
+    emulate_instructions_profiled(chip8, profile, INSTRUCTS_PER_SECOND / 60);
+    update_timers(chip8);
+}
+
+static void run_test(const regress_t *rg, test_t *test)
+{
+    char path[1024];
+    uint32_t check_frames[MAX_CHECKS];
+    uint64_t expected[MAX_CHECKS];
+
+    snprintf(path, sizeof path, "%s/%s.golden", rg->dir, test->name);
+    int checks = rg->update ? -1 : read_golden(path, check_frames, expected);
+    const bool writing = checks < 0;
+    if (writing)
+    {
+        checks = 0;
+        for (uint32_t f = rg->every; f <= rg->frames && checks < MAX_CHECKS; f += rg->every) check_frames[checks++] = f;
+    }
+
+    uint32_t last_frame = 0;
+    for (int c = 0; c < checks; c++) last_frame = check_frames[c] > last_frame ? check_frames[c] : last_frame;
+
+    uint16_t *keys = calloc(last_frame + 1, sizeof *keys);
+    snprintf(path, sizeof path, "%s/%s.keys", rg->dir, test->name);
+    FILE *movie = fopen(path, "r");
+    if (movie)
+    {
+        fclose(movie);
+        load_movie(path, keys, last_frame + 1);
+    }
+
+    chip8_t chip8 = {0};
+    chip8_profile_t *profile = rg->smc ? calloc(1, sizeof *profile) : NULL;
+    snprintf(path, sizeof path, "%s/%s%s", rg->dir, test->name, test->ext);
+    if (!keys || (rg->smc && !profile) || !init_chip8(&chip8, path, platform_from_rom_name(path)))
+    {
+        test->result = RESULT_ERROR;
+        snprintf(test->detail, sizeof test->detail, "could not load");
+        free(profile);
+        free(keys);
+        return;
+    }
+
+    // run frame by frame, hashing the display after each checked frame (frame 0: before any)
+    uint64_t actual[MAX_CHECKS];
+    const uint64_t initial = hash_display(chip8.display, chip8.display_planes, chip8.hires);
+    for (int c = 0; c < checks; c++) actual[c] = initial;
+    for (uint32_t f = 1; f <= last_frame; f++)
+    {
+        apply_keys(&chip8, keys[f - 1]);
+        if (profile) run_frame_profiled(&chip8, profile);
+        else run_frame(&chip8);
+
+        const uint64_t h = hash_display(chip8.display, chip8.display_planes, chip8.hires);
+        for (int c = 0; c < checks; c++)
+        {
+            if (check_frames[c] == f) actual[c] = h;
+        }
+    }
+    const uint8_t fault = chip8.fault;
+    free_chip8(&chip8);
+    free(keys);
+
+    // faults don't fail a test by themselves, but a ROM that overflows its stack is worth knowing about
+    char notes[128] = "";
+    size_t len = 0;
+    if (fault)
+    {
+        char names[48];
+        describe_faults(fault, names, sizeof names);
+        len += snprintf(notes, sizeof notes, " (faults: %s)", names);
+    }
+    if (profile)
+    {
+        test->rewrites = profile->total_rewrites;
+        for (uint32_t a = 0; a < RAM_SIZE; a++) test->rewritten_addrs += profile->rewrites[a] != 0;
+        if (test->rewrites)
+        {
+            snprintf(notes + len, sizeof notes - len, " (self-modifying: %llu rewritten instructions run at %u addresses)",
+                     (unsigned long long)test->rewrites, test->rewritten_addrs);
+        }
+        free(profile);
+    }
+
+    if (writing)
+    {
+        snprintf(path, sizeof path, "%s/%s.golden", rg->dir, test->name);
+        FILE *out = fopen(path, "w");
+        if (!out)
+        {
+            test->result = RESULT_ERROR;
+            snprintf(test->detail, sizeof test->detail, "could not write golden");
+            return;
+        }
+        for (int c = 0; c < checks; c++) fprintf(out, "%u %016llx\n", check_frames[c], (unsigned long long)actual[c]);
+        fclose(out);
+        test->result = RESULT_NEW;
+        snprintf(test->detail, sizeof test->detail, "%d frames recorded%s", checks, notes);
+        return;
+    }
+
+    test->result = RESULT_PASS;
+    snprintf(test->detail, sizeof test->detail, "%d frames%s", checks, notes);
+    for (int c = 0; c < checks; c++)
+    {
+        if (actual[c] == expected[c]) continue;
+        test->result = RESULT_FAIL;
+        snprintf(test->detail, sizeof test->detail, "frame %u: expected %016llx got %016llx",
+                 check_frames[c], (unsigned long long)expected[c], (unsigned long long)actual[c]);
+        break;
+    }
+}
+
+static void *regress_worker(void *arg)
+{
+    regress_t *rg = arg;
+    for (;;)
+    {
+        const uint32_t i = atomic_fetch_add(&rg->next_test, 1);
+        if (i >= rg->num_tests) break;
+        run_test(rg, &rg->tests[i]);
+    }
+    return NULL;
+}
+
+static int by_name(const void *a, const void *b)
+{
+    return strcmp(((const test_t *)a)->name, ((const test_t *)b)->name);
+}
+
+// every ROM in dir
+static bool find_tests(regress_t *rg)
+{
+    DIR *dir = opendir(rg->dir);
+    if (!dir)
+    {
+        fprintf(stderr, "Could not open ROM directory %s\n", rg->dir);
+        return false;
+    }
+
+    uint32_t capacity = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)))
+    {
+        const size_t len = strlen(entry->d_name);
+        if (len < 5 || len - 4 >= sizeof rg->tests[0].name || !is_rom_name(entry->d_name)) continue;
+
+        if (rg->num_tests == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            test_t *tests = realloc(rg->tests, capacity * sizeof *tests);
+            if (!tests) break;
+            rg->tests = tests;
+        }
+        test_t *test = &rg->tests[rg->num_tests++];
+        memset(test, 0, sizeof *test);
+        const bool chip8_rom = platform_from_rom_name(entry->d_name) == PLATFORM_CHIP8;
+        memcpy(test->name, entry->d_name, chip8_rom ? len - 4 : len);
+        if (chip8_rom) memcpy(test->ext, entry->d_name + len - 4, 4);
+    }
+    closedir(dir);
+
+    if (rg->num_tests) qsort(rg->tests, rg->num_tests, sizeof *rg->tests, by_name);
+    return true;
+}
+
+// - - - - - - - - -
+// MAIN PROGRAM
+// - - - - - - - - -
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <Rom-Dir> [--jobs J] [--frames F] [--every E] [--update] [--smc]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    static regress_t rg;
+    rg.dir = argv[1];
+    rg.frames = 600;
+    rg.every = 60;
+    uint32_t jobs = SDL_GetCPUCount();
+
+    for (int i = 2; i < argc; i++)
+    {
+        const bool has_val = i + 1 < argc;
+        if (!strcmp(argv[i], "--jobs") && has_val) jobs = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--frames") && has_val) rg.frames = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--every") && has_val) rg.every = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--update")) rg.update = true;
+        else if (!strcmp(argv[i], "--smc")) rg.smc = true;
+        else
+        {
+            fprintf(stderr, "Unknown or incomplete option %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (jobs == 0) jobs = 1;
+    if (rg.every == 0) rg.every = 1;
+
+    if (!find_tests(&rg)) exit(EXIT_FAILURE);
+    if (jobs > rg.num_tests) jobs = rg.num_tests ? rg.num_tests : 1;
+
+    pthread_t *workers = malloc(jobs * sizeof *workers);
+    for (uint32_t t = 0; t < jobs; t++) pthread_create(&workers[t], NULL, regress_worker, &rg);
+    for (uint32_t t = 0; t < jobs; t++) pthread_join(workers[t], NULL);
+    free(workers);
+
+    // report in name order, whatever order the workers finished in
+    uint32_t counts[4] = {0};
+    uint32_t self_modifying = 0;
+    for (uint32_t i = 0; i < rg.num_tests; i++)
+    {
+        const test_t *test = &rg.tests[i];
+        printf("%s %s: %s\n", result_names[test->result], test->name, test->detail);
+        counts[test->result]++;
+        self_modifying += test->rewrites != 0;
+    }
+    printf("%u passed, %u failed, %u new, %u errors\n",
+           counts[RESULT_PASS], counts[RESULT_FAIL], counts[RESULT_NEW], counts[RESULT_ERROR]);
+    if (rg.smc) printf("%u of %u ROMs ran self-modified code\n", self_modifying, rg.num_tests);
+
+    free(rg.tests);
+    exit(counts[RESULT_FAIL] || counts[RESULT_ERROR] ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,78 @@
+// - - - - - - - - - - - - - -
+//   CHIP-8 TRACE DECODER
+// - - - - - - - - - - - - - -
+// Turns a binary trace written by the DEBUG build (--trace FILE, or F1 at runtime) back
+// into text: one line per executed instruction with its cycle, address, opcode and
+// description, followed by I and every register the instruction changed.
+//
+// usage: chip8_tracedump <Trace-File> [--from CYCLE] [--count N]
+
+#define CHIP8_NO_MAIN
+#include "chip8.c"
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <Trace-File> [--from CYCLE] [--count N]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t from = 0;
+    uint64_t count = UINT64_MAX;
+    for (int i = 2; i < argc; i++)
+    {
+        const bool has_val = i + 1 < argc;
+        if (!strcmp(argv[i], "--from") && has_val) from = strtoull(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--count") && has_val) count = strtoull(argv[++i], NULL, 0);
+        else
+        {
+            fprintf(stderr, "Unknown or incomplete option %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    FILE *in = fopen(argv[1], "rb");
+    if (!in)
+    {
+        fprintf(stderr, "Could not open trace %s\n", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+
+    trace_header_t header;
+    if (fread(&header, sizeof header, 1, in) != 1 || memcmp(header.magic, TRACE_MAGIC, sizeof header.magic) ||
+        header.version != TRACE_VERSION || header.entry_size != sizeof(trace_entry_t))
+    {
+        fprintf(stderr, "%s is not a version %u trace\n", argv[1], TRACE_VERSION);
+        fclose(in);
+        exit(EXIT_FAILURE);
+    }
+
+    trace_entry_t e;
+    uint64_t printed = 0;
+    uint64_t expected = UINT64_MAX;
+    while (printed < count && fread(&e, sizeof e, 1, in) == 1)
+    {
+        if (e.cycle < from) continue;
+
+        // gaps are instructions the ring dropped or that ran while tracing was off
+        if (expected != UINT64_MAX && e.cycle != expected)
+        {
+            printf("... %llu instructions not traced\n", (unsigned long long)(e.cycle - expected));
+        }
+        expected = e.cycle + 1;
+
+        char desc[128];
+        disassemble_instruction(e.opcode, desc, sizeof desc);
+        printf("%10llu  0x%04X  0x%04X  %-60s I:0x%04X", (unsigned long long)e.cycle, e.PC, e.opcode, desc, e.I);
+        for (uint8_t i = 0; i < 16; i++)
+        {
+            if (e.V_changed & (1 << i)) printf(" V%X:0x%02X", i, e.V[i]);
+        }
+        printf("\n");
+        printed++;
+    }
+
+    fclose(in);
+    exit(EXIT_SUCCESS);
+}
@@ -6,4 +6,35 @@ all:
 	gcc chip8.c -o chip8 $(CFLAGS) -L$(LIBS) -I$(INCLUDE)
 
 debug:
-	gcc chip8.c -o chip8 $(CFLAGS) -L$(LIBS) -I$(INCLUDE) -DDEBUG
\ No newline at end of file
+	gcc chip8.c -o chip8 $(CFLAGS) -L$(LIBS) -I$(INCLUDE) -DDEBUG
+
+metrics:
+	gcc chip8.c -o chip8 $(CFLAGS) -L$(LIBS) -I$(INCLUDE) -DCHIP8_METRICS_HTTP -lws2_32
+
+tracedump:
+	gcc chip8_tracedump.c -o chip8_tracedump $(CFLAGS) -O2 -L$(LIBS) -I$(INCLUDE)
+
+disasm:
+	gcc chip8_disasm.c -o chip8_disasm $(CFLAGS) -O2 -L$(LIBS) -I$(INCLUDE)
+
+env:
+	gcc chip8_env.c -o chip8_env.so -shared -fPIC $(CFLAGS) -O3 -mavx2 -L$(LIBS) -I$(INCLUDE)
+
+fuzz:
+	clang chip8_fuzz.c -o chip8_fuzz $(CFLAGS) -O2 -g -fsanitize=fuzzer,address -L$(LIBS) -I$(INCLUDE)
+
+fuzz_replay:
+	gcc chip8_fuzz.c -o chip8_fuzz $(CFLAGS) -O2 -g -DCHIP8_FUZZ_STANDALONE -L$(LIBS) -I$(INCLUDE)
+
+explore:
+	gcc chip8_explore.c -o chip8_explore $(CFLAGS) -O2 -pthread -L$(LIBS) -I$(INCLUDE)
+
+difftest:
+	gcc chip8_difftest.c -o chip8_difftest $(CFLAGS) -O2 -L$(LIBS) -I$(INCLUDE)
+
+regress:
+	gcc chip8_regress.c -o chip8_regress $(CFLAGS) -O2 -pthread -L$(LIBS) -I$(INCLUDE)
+
+bench:
+	gcc chip8_bench.c -o chip8_bench $(CFLAGS) -O3 -mavx2 -L$(LIBS) -I$(INCLUDE)
+	./chip8_bench --json bench.json